@@ -0,0 +1,128 @@
+/****************************************************************
+* Benchmark: util::par on workloads with skewed per-element cost
+*
+* Runs a batch of elements through util::par::for_each with  each
+* schedule  and  reports  the  distribution of the time taken per
+* batch. With STATIC scheduling a batch takes as  long  as  the
+* unluckiest job's range, so the tail  of  the  batch  latency
+* follows the heaviest elements;  with STEALING idle jobs take
+* over the remaining work of the slow ones.
+*
+* Usage: bench-par-skew [rounds] [jobs]
+****************************************************************/
+#include "base-util/algo-par.hpp"
+#include "base-util/main.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <numeric>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace std::chrono;
+
+using util::par::Schedule;
+
+namespace {
+
+// Busy-wait rather than sleep so that each element occupies  its
+// thread the way real work would.
+void spin( nanoseconds d ) {
+    auto end = steady_clock::now() + d;
+    while( steady_clock::now() < end ) {}
+}
+
+// Costs drawn from a Pareto distribution: most elements take a
+// few microseconds but a few take milliseconds.
+vector<nanoseconds> pareto_costs( size_t n, unsigned seed ) {
+    constexpr double alpha = 1.2;
+    constexpr double scale = 4000; // ns
+    constexpr double cap   = 20e6; // ns
+    mt19937 gen( seed );
+    uniform_real_distribution<double> u( 0.0, 1.0 );
+    vector<nanoseconds> res( n );
+    for( auto& c : res ) {
+        double x = scale / pow( 1.0 - u( gen ), 1.0/alpha );
+        c = nanoseconds( int64_t( min( x, cap ) ) );
+    }
+    return res;
+}
+
+// Uniform cheap elements except for a cluster of expensive ones
+// at the start of the range, all of which land in the  first
+// job's range under STATIC scheduling.
+vector<nanoseconds> clustered_costs( size_t n ) {
+    vector<nanoseconds> res( n, nanoseconds( 5000 ) );
+    for( size_t i = 0; i < n/50; ++i )
+        res[i] = nanoseconds( 500000 );
+    return res;
+}
+
+struct Stats {
+    double p50;
+    double p99;
+    double max;
+};
+
+double percentile( vector<double> const& sorted, double p ) {
+    size_t idx = size_t( p*double( sorted.size()-1 ) );
+    return sorted[idx];
+}
+
+Stats measure( vector<nanoseconds> const& costs, int jobs,
+               Schedule sched, int rounds ) {
+    vector<size_t> idxs( costs.size() );
+    iota( idxs.begin(), idxs.end(), 0 );
+    auto work = [&]( size_t i ){ spin( costs[i] ); };
+
+    vector<double> ms;
+    for( int r = 0; r < rounds; ++r ) {
+        auto t0 = steady_clock::now();
+        util::par::for_each( idxs, work, jobs, sched );
+        auto t1 = steady_clock::now();
+        ms.push_back( duration<double, milli>( t1-t0 ).count() );
+    }
+    sort( ms.begin(), ms.end() );
+    return { percentile( ms, 0.5 ), percentile( ms, 0.99 ),
+             ms.back() };
+}
+
+void report( char const* name, vector<nanoseconds> const& costs,
+             int jobs, int rounds ) {
+    auto total = accumulate( costs.begin(), costs.end(),
+                             nanoseconds( 0 ) );
+    double ideal = duration<double, milli>( total ).count()/jobs;
+    for( auto [sched, sched_name] :
+            { pair{ Schedule::STATIC,   "STATIC"   },
+              pair{ Schedule::STEALING, "STEALING" } } ) {
+        auto s = measure( costs, jobs, sched, rounds );
+        printf( "%-10s %-9s %9.2f %9.2f %9.2f %9.2f\n", name,
+                sched_name, s.p50, s.p99, s.max, ideal );
+    }
+}
+
+} // anonymous namespace
+
+int main_( int argc, char** argv ) {
+    int rounds = argc > 1 ? atoi( argv[1] ) : 30;
+    int jobs   = argc > 2 ? atoi( argv[2] )
+                          : util::par::max_threads();
+    rounds = max( rounds, 1 );
+    jobs   = max( jobs, 1 );
+
+    constexpr size_t n = 4000;
+
+    printf( "elements: %zu, jobs: %d, rounds: %d\n", n, jobs,
+            rounds );
+    printf( "%-10s %-9s %9s %9s %9s %9s\n", "workload",
+            "schedule", "p50 ms", "p99 ms", "max ms", "ideal ms" );
+
+    report( "pareto",    pareto_costs( n, 12345 ), jobs, rounds );
+    report( "clustered", clustered_costs( n ),     jobs, rounds );
+    return 0;
+}
@@ -0,0 +1,94 @@
+/****************************************************************
+* Benchmark: util::par sorting versus the serial util versions
+*
+* Sorts random integers and strings, and key-sorts records by an
+* integral and by a string key, reporting the best time of  each
+* over a few rounds.
+*
+* Usage: bench-par-sort [n] [jobs]
+****************************************************************/
+#include "base-util/algo-par.hpp"
+#include "base-util/algo.hpp"
+#include "base-util/main.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace std::chrono;
+
+namespace {
+
+constexpr int rounds = 5;
+
+struct Record {
+    int64_t id;
+    string  name;
+};
+
+// Best time in ms of running f on a fresh copy of the input.
+template<typename T, typename FuncT>
+double best_ms( vector<T> const& input, FuncT f ) {
+    double best = 1e300;
+    for( int r = 0; r < rounds; ++r ) {
+        auto v  = input;
+        auto t0 = steady_clock::now();
+        f( v );
+        auto t1 = steady_clock::now();
+        best = min( best, duration<double, milli>( t1-t0 ).count() );
+    }
+    return best;
+}
+
+void report( char const* name, double serial, double par ) {
+    printf( "%-16s %10.2f %10.2f %8.2fx\n", name, serial, par,
+            serial/par );
+}
+
+} // anonymous namespace
+
+int main_( int argc, char** argv ) {
+    size_t n    = argc > 1 ? size_t( atol( argv[1] ) ) : 2000000;
+    int    jobs = argc > 2 ? atoi( argv[2] ) : 0;
+
+    mt19937_64 gen( 42 );
+
+    vector<int64_t> ints( n );
+    for( auto& x : ints ) x = int64_t( gen() );
+
+    vector<string> strs( n/4 );
+    for( auto& s : strs ) s = to_string( gen() );
+
+    vector<Record> recs( n/4 );
+    for( auto& r : recs ) r = { int64_t( gen() % 100000 ),
+                                to_string( gen() % 100000 ) };
+    auto by_id   = []( Record const& r ){ return r.id; };
+    auto by_name = []( Record const& r ){ return r.name; };
+
+    printf( "n: %zu, jobs: %d\n", n, jobs );
+    printf( "%-16s %10s %10s %9s\n", "test", "serial ms", "par ms",
+            "speedup" );
+
+    report( "sort int64",
+        best_ms( ints, []( auto& v ){ util::sort( v ); } ),
+        best_ms( ints, [&]( auto& v ){ util::par::sort( v, jobs ); } ) );
+    report( "sort string",
+        best_ms( strs, []( auto& v ){ util::sort( v ); } ),
+        best_ms( strs, [&]( auto& v ){ util::par::sort( v, jobs ); } ) );
+    report( "sort_by_key id",
+        best_ms( recs, [&]( auto& v ){
+            util::stable_sort_by_key( v, by_id ); } ),
+        best_ms( recs, [&]( auto& v ){
+            util::par::sort_by_key( v, by_id, jobs ); } ) );
+    report( "sort_by_key name",
+        best_ms( recs, [&]( auto& v ){
+            util::stable_sort_by_key( v, by_name ); } ),
+        best_ms( recs, [&]( auto& v ){
+            util::par::sort_by_key( v, by_name, jobs ); } ) );
+    return 0;
+}
@@ -3,7 +3,12 @@
 ****************************************************************/
 #include "base-util/algo-par.hpp"
 
+#include <atomic>
+#include <exception>
+#include <memory>
+#include <optional>
 #include <thread>
+#include <utility>
 
 using namespace std;
 
@@ -19,18 +24,313 @@ int max_threads() {
     return 1;
 }
 
-// Will take a vector of functions and will run  each  one  in  a
-// separate  thread. The functions are expected to take no parame-
-// ters  and  to  return  no values. This is a somewhat low-level
-// function that should probably not be called  except  by  other
-// functions in this module.
+/****************************************************************
+* ThreadPool
+****************************************************************/
+// State shared between the caller of run() and the helper  tasks
+// that it enqueues onto the workers. Jobs are claimed by atomic-
+// ally incrementing `next`, so each job is run exactly once  re-
+// gardless  of  which thread gets to it. This is held by shared_-
+// ptr because a helper task may only get dequeued after run() has
+// already returned, in which case it will find that all jobs have
+// been claimed and will return without touching `funcs` (which
+// is why the number of jobs is stored separately in `size`).
+struct ThreadPool::Batch {
+    vector<function<void()>> const* funcs{ nullptr };
+    size_t                          size{ 0 };
+    atomic<size_t>                  next{ 0 };
+
+    mutex              mtx;
+    condition_variable cv;
+    size_t             remaining{ 0 };
+    exception_ptr      error;
+
+    // Run jobs from the batch until there are none left to claim.
+    void drain() {
+        for( size_t i = next++; i < size; i = next++ ) {
+            exception_ptr e;
+            try {
+                (*funcs)[i]();
+            } catch( ... ) {
+                e = current_exception();
+            }
+            lock_guard<mutex> lock( mtx );
+            if( e && !error )
+                error = e;
+            if( --remaining == 0 )
+                cv.notify_all();
+        }
+    }
+};
+
+ThreadPool::ThreadPool( int threads ) {
+    ASSERT_( threads >= 0 );
+    if( threads == 0 )
+        threads = max_threads();
+    m_threads.reserve( threads );
+    for( int i = 0; i < threads; ++i )
+        m_threads.emplace_back( [this]{ worker(); } );
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        lock_guard<mutex> lock( m_mutex );
+        m_stopping = true;
+    }
+    m_cv.notify_all();
+    for( auto& t : m_threads ) t.join();
+}
+
+// Each worker thread just sits in this loop  pulling  tasks  off
+// of the queue until the pool is destroyed.
+void ThreadPool::worker() {
+    while( true ) {
+        function<void()> task;
+        {
+            unique_lock<mutex> lock( m_mutex );
+            m_cv.wait( lock, [this]{
+                return m_stopping || !m_queue.empty();
+            } );
+            if( m_queue.empty() )
+                return; // stopping
+            task = std::move( m_queue.front() );
+            m_queue.pop_front();
+        }
+        task();
+    }
+}
+
+void ThreadPool::run( vector<function<void()>> const& v ) {
+
+    if( v.empty() )
+        return;
+
+    auto batch = make_shared<Batch>();
+    batch->funcs     = &v;
+    batch->size      = v.size();
+    batch->remaining = v.size();
+
+    // The calling thread will take  one  share  of  the  work,  so
+    // we only need to wake up enough workers  to  cover  the  rest.
+    size_t helpers = min( v.size()-1, m_threads.size() );
+    if( helpers > 0 ) {
+        {
+            lock_guard<mutex> lock( m_mutex );
+            for( size_t i = 0; i < helpers; ++i )
+                m_queue.emplace_back( [batch]{ batch->drain(); } );
+        }
+        if( helpers == 1 )
+            m_cv.notify_one();
+        else
+            m_cv.notify_all();
+    }
+
+    batch->drain();
+
+    exception_ptr error;
+    {
+        unique_lock<mutex> lock( batch->mtx );
+        batch->cv.wait( lock, [&]{ return batch->remaining == 0; } );
+        // Take the exception out of the batch so that it is not re-
+        // leased by a late helper (that still holds a reference  to
+        // the batch) while the caller is handling it.
+        error = std::move( batch->error );
+    }
+
+    if( error )
+        rethrow_exception( error );
+}
+
+namespace {
+
+// Number of threads with which to create the default  pool;  zero
+// means max_threads().
+atomic<int>  g_default_pool_size{ 0 };
+atomic<bool> g_default_pool_created{ false };
+
+} // anonymous namespace
+
+// Sets the number of threads that the default pool will be  cre-
+// ated with (zero means max_threads(), which is the default). The
+// default pool is created lazily on first  use,  and  so  this
+// must be called before then, otherwise it will throw.
+void set_default_pool_size( int threads ) {
+    ASSERT_( threads >= 0 );
+    ASSERT( !g_default_pool_created,
+            "the default thread pool has already been created." );
+    g_default_pool_size = threads;
+}
+
+// The global pool on which all of the algorithms in this  module
+// run unless they are given a pool explicitly. It is created  on
+// first use.
+ThreadPool& default_pool() {
+    static ThreadPool pool( [] {
+        g_default_pool_created = true;
+        return g_default_pool_size.load();
+    }() );
+    return pool;
+}
+
+// Will take a vector of functions and run them in  parallel  on
+// the given pool, returning when all have finished. The  func-
+// tions are expected to take no parameters and to return no val-
+// ues. This is a somewhat low-level function that should probably
+// not be called except by other functions in this module.
+void in_parallel( ThreadPool&                     pool,
+                  vector<function<void()>> const& v ) {
+    pool.run( v );
+}
+
+// Same as above but runs on the default pool.
 void in_parallel( vector<function<void()>> const& v ) {
+    in_parallel( default_pool(), v );
+}
+
+/****************************************************************
+* Scheduling
+****************************************************************/
+namespace {
+
+using RangeBody = function<bool( size_t, size_t, size_t )>;
 
-    vector<thread> ts; ts.reserve( v.size() );
+// Each job gets one contiguous range of  equal  size,  with  the
+// last job also taking the remainder.
+void for_ranges_static( ThreadPool& pool, size_t size, size_t jobs,
+                        RangeBody const& body ) {
+    size_t chunk = size/jobs;
+    vector<function<void()>> funcs( jobs );
+    for( size_t i = 0; i < jobs; ++i ) {
+        funcs[i] = [&, i]{
+            auto start = i*chunk;
+            auto end   = (i == jobs-1) ? size : start+chunk;
+            body( i, start, end );
+        };
+    }
+    in_parallel( pool, funcs );
+}
+
+// The range of indexes  currently  owned  by  one  job  under  the
+// STEALING schedule. The owner takes chunks  off  of  the  front
+// and thieves take from the back, so it acts as a double-ended
+// queue of indexes.
+struct alignas( detail::cache_line_size ) WorkRange {
+    mutex  mtx;
+    size_t begin{ 0 };
+    size_t end{ 0 };
+};
+
+// Each chunk that a job takes from its own range is this fraction
+// of what remains in the range, so that chunks  start  out  large
+// (low overhead) and get smaller as the range is consumed (so
+// that a slow element holds up less work behind it).
+constexpr size_t guided_divisor = 8;
+
+void for_ranges_stealing( ThreadPool& pool, size_t size,
+                          size_t jobs, RangeBody const& body ) {
+    // Constructed in place, never moved, since it holds mutexes.
+    vector<WorkRange> ranges( jobs );
+    size_t chunk = size/jobs;
+    for( size_t i = 0; i < jobs; ++i ) {
+        ranges[i].begin = i*chunk;
+        ranges[i].end   = (i == jobs-1) ? size : (i+1)*chunk;
+    }
+
+    // Set when a body signals that we should stop.
+    atomic<bool> stop{ false };
+    // Number of stolen ranges that have  been  removed  from  the
+    // victim but not yet  installed  in  the  thief's  range.  A
+    // job that finds nothing to steal must not give up while this
+    // is non-zero, since there is work that it could not see.
+    atomic<int> in_transit{ 0 };
+
+    // Take the next chunk from the front of a range.
+    auto take = []( WorkRange& r ) -> optional<pair<size_t, size_t>> {
+        lock_guard<mutex> lock( r.mtx );
+        size_t remaining = r.end - r.begin;
+        if( remaining == 0 )
+            return nullopt;
+        size_t start = r.begin;
+        r.begin += max<size_t>( 1, remaining/guided_divisor );
+        return pair{ start, r.begin };
+    };
+
+    // Try to steal the back half of another job's range and  make
+    // it our own. Returns true if something was stolen.
+    auto steal = [&]( size_t thief ) {
+        for( size_t k = 1; k < jobs; ++k ) {
+            auto& victim = ranges[(thief+k) % jobs];
+            size_t start = 0, end = 0;
+            {
+                lock_guard<mutex> lock( victim.mtx );
+                size_t remaining = victim.end - victim.begin;
+                if( remaining == 0 )
+                    continue;
+                ++in_transit;
+                start      = victim.begin + remaining/2;
+                end        = victim.end;
+                victim.end = start;
+            }
+            {
+                auto& own = ranges[thief];
+                lock_guard<mutex> lock( own.mtx );
+                own.begin = start;
+                own.end   = end;
+            }
+            --in_transit;
+            return true;
+        }
+        return false;
+    };
+
+    auto job = [&]( size_t i ) {
+        while( !stop ) {
+            auto next = take( ranges[i] );
+            if( !next ) {
+                if( steal( i ) )
+                    continue;
+                if( in_transit > 0 ) {
+                    this_thread::yield();
+                    continue;
+                }
+                return; // No work left anywhere.
+            }
+            if( !body( i, next->first, next->second ) )
+                stop = true;
+        }
+    };
+
+    vector<function<void()>> funcs( jobs );
+    for( size_t i = 0; i < jobs; ++i )
+        funcs[i] = [&job, i]{ job( i ); };
+    in_parallel( pool, funcs );
+}
 
-    for( auto const& e : v ) ts.emplace_back( e );
+} // anonymous namespace
 
-    for( auto& t : ts ) t.join();
+// Divides the index range [0, size) among `jobs` jobs running on
+// the pool according  to  the  schedule,  calling  body( job_idx,
+// start, end ) on disjoint sub-ranges [start, end) that together
+// cover the whole range. The body should return false to  signal
+// that  its  job  should  stop  (e.g.,  on  error), in which case
+// with STEALING all other jobs will stop taking  new  chunks  as
+// well.
+void for_ranges( ThreadPool& pool, size_t size, size_t jobs,
+                 Schedule sched, RangeBody const& body ) {
+    // Never create more jobs than there are elements. jobs may end
+    // up being zero here, and that is ok: it  means  that  there
+    // is nothing to do.
+    jobs = min( jobs, size );
+    if( jobs == 0 )
+        return;
+    switch( sched ) {
+        case Schedule::STATIC:
+            for_ranges_static( pool, size, jobs, body );
+            break;
+        case Schedule::STEALING:
+            for_ranges_stealing( pool, size, jobs, body );
+            break;
+    }
 }
 
 } // namespace util::par
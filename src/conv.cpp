@@ -25,6 +25,12 @@ namespace conv {
 // If the input is empty the the  function will yield an empty re-
 // sult even if bom is true.
 vector<char> ascii_2_utf16le( vector<char> const& v, bool bom ) {
+    return ascii_2_utf16le( span<char const>( v ), bom );
+}
+
+// Same as above but for any contiguous range of chars, e.g.  the
+// contents of a MappedFile.
+vector<char> ascii_2_utf16le( span<char const> v, bool bom ) {
 
     vector<char> res; res.reserve( (bom ? 2 : 0) + v.size()*2 );
 
@@ -46,13 +52,22 @@ vector<char> ascii_2_utf16le( vector<char> const& v, bool bom ) {
     return res;
 }
 
+vector<char> ascii_2_utf16le( util::MappedFile const& f, bool bom ) {
+    return ascii_2_utf16le( f.span(), bom );
+}
+
 // Will call ascii_2_utf16le on a vector containing the  contents
 // of  the  file;  note that byte order mark (BOM) is inserted at
 // the start of the file by default. Will  throw  if  input  file
 // contains any non-ascii characters.
 void ascii_2_utf16le( fs::path const& p, bool bom ) {
-    util::write_file( p,
-            ascii_2_utf16le( util::read_file( p ), bom ) );
+    vector<char> res;
+    {
+        // The mapping must be gone before the file is rewritten.
+        util::MappedFile in( p );
+        res = ascii_2_utf16le( in, bom );
+    }
+    util::write_file( p, res );
 }
 
 } // namespace conv
@@ -4,10 +4,17 @@
 #include "base-util/datetime.hpp"
 #include "base-util/macros.hpp"
 
+#include "simd.hpp"
+
 #include <array>
+#include <atomic>
+#include <bit>
 #include <cmath>
+#include <cstdint>
+#include <cstring>
 #include <ctime>
 #include <iomanip>
+#include <limits>
 
 #ifdef _WIN32
 #include "Windows.h"
@@ -20,26 +27,22 @@ namespace util {
 
 namespace impl {
 
-// Return  the  offset in seconds from the local time zone to UTC.
-TZOffset tz_local() {
 #ifndef _WIN32
-    // The value of this variable matters not  because  we're  in-
-    // terested in the current time (we will only be sampling the
-    // tm_gmtoff field from the result  which  is a function only
-    // of timezone offset)  but  instead  because the localtime_r
-    // function will decide based on the current time which phase
-    // of daylight savings time  we  are  in  which will be added
-    // into tm_gmtoff.
-    time_t time = ::time( nullptr );
+// Return the offset in seconds from the local time zone to UTC in
+// effect at the given time (which includes daylight savings time
+// if it is in effect then).
+TZOffset tz_local_at( time_t time ) {
     // This will be populated by localtime_r.
     tm local{};
     // localtime_r is a threadsafe version  of localtime since it
     // does  not  mutate  any  global  data, though it may not be
     // fully portable.
     localtime_r( &time, &local );
-
     return seconds( local.tm_gmtoff );
+}
 #else
+// Return  the  offset in seconds from the local time zone to UTC.
+TZOffset tz_local_now() {
     TIME_ZONE_INFORMATION lpTimeZoneInformation;
     auto ds = GetTimeZoneInformation(
                   &lpTimeZoneInformation );
@@ -48,20 +51,97 @@ TZOffset tz_local() {
     if( ds == TIME_ZONE_ID_DAYLIGHT )
         offset_min += lpTimeZoneInformation.DaylightBias;
     return seconds( -60*offset_min );
+}
 #endif
+
 }
 
+// How far ahead we look for the next change  in  offset.  Even
+// when there is none we check again after this long, which  also
+// picks up changes to the system's time zone settings.
+constexpr seconds tz_horizon = hours( 24 );
+
+detail::TZWindow detail::tz_local_window( seconds now ) {
+#ifndef _WIN32
+    // localtime_r is not required to (and on glibc does not) look
+    // at TZ or /etc/localtime again after the first call  unless
+    // tzset is called. This runs at most about once a day.
+    tzset();
+    auto    off_at = []( int64_t t ) {
+        return impl::tz_local_at( time_t( t ) );
+    };
+    int64_t start = now.count();
+    auto    off   = off_at( start );
+    // Probe an hour at a time; offsets do not change more than once
+    // in that span. When one of the probes differs, bisect between
+    // it and the previous one to find the second at which the  new
+    // offset takes effect.
+    constexpr int64_t step = 3600;
+    for( int64_t lo = start; lo < start + tz_horizon.count();
+         lo += step ) {
+        int64_t hi = lo + step;
+        if( off_at( hi ) == off )
+            continue;
+        // Invariant: off_at( lo ) == off, off_at( hi ) != off.
+        while( hi - lo > 1 ) {
+            int64_t mid = lo + ( hi - lo )/2;
+            if( off_at( mid ) == off )
+                lo = mid;
+            else
+                hi = mid;
+        }
+        return { off, seconds( hi ) };
+    }
+    return { off, now + tz_horizon };
+#else
+    // There is no easy way to ask Windows for the offset  at  an
+    // arbitrary time, so just check again in a minute.
+    return { impl::tz_local_now(), now + minutes( 1 ) };
+#endif
+}
+
+namespace {
+
+// The cached offset and the time until which it  is  valid  are
+// packed into one word so that readers can get a consistent snap-
+// shot of both without locking. The low bits hold the  offset,
+// which is less than a day in magnitude, biased to make it non-
+// negative; the rest hold the end of the window in seconds since
+// the epoch. A value of zero means nothing is cached yet.
+constexpr int      tz_offset_bits = 18;
+constexpr int64_t  tz_offset_bias = int64_t( 1 ) << ( tz_offset_bits-1 );
+constexpr uint64_t tz_offset_mask =
+    ( uint64_t( 1 ) << tz_offset_bits ) - 1;
+
+atomic<uint64_t> g_tz_local{ 0 };
+
+uint64_t pack_tz( detail::TZWindow const& w ) {
+    auto until = max<int64_t>( w.valid_until.count(), 0 );
+    return ( uint64_t( until ) << tz_offset_bits ) |
+           uint64_t( w.offset.count() + tz_offset_bias );
 }
 
+} // namespace
+
 // Return  the  offset in seconds from the local time zone to UTC.
-// Note  that  the  result of this function will be memoized in a
-// static variable for efficiency,  so  it  should  not be called
-// from a process that runs for longer than a day on the day when
-// daylight savings time changes (seems to to be a  big  deal  in
-// practice).
+// The result is cached along with the time at  which  it  is  next
+// due to change (e.g. when daylight savings time starts or stops),
+// after which it is recomputed. Readers only do an atomic load and
+// a comparison with the current time.
 TZOffset tz_local() {
-    static TZOffset __tz_local = impl::tz_local();
-    return __tz_local;
+    auto     now  = floor<seconds>( system_clock::now() )
+                        .time_since_epoch();
+    uint64_t snap = g_tz_local.load( memory_order_acquire );
+    if( snap != 0 &&
+        now.count() < int64_t( snap >> tz_offset_bits ) )
+        return seconds( int64_t( snap & tz_offset_mask ) -
+                        tz_offset_bias );
+    // Several threads may get here at once when the window  ends;
+    // they will all compute the same thing, so it doesn't  matter
+    // which store wins.
+    auto window = detail::tz_local_window( now );
+    g_tz_local.store( pack_tz( window ), memory_order_release );
+    return window.offset;
 }
 
 // Returns  a string representation of the offset between UTC and
@@ -95,41 +175,100 @@ string tz_hhmm( TZOffset off ) {
     return res;
 }
 
-// Formats  a  local  epoch  time specified in seconds in the fol-
-// lowing format: "2018-01-15 20:52:48". Strings of this form can
-// be compared lexicographically for he  purposes of comparing by
-// time ordering.
-string fmt_time( seconds time ) {
+namespace {
 
-    // Not great, but we have to dip into C here...
-    time_t t = time.count();
+// Converts a number of days since 1970-01-01 into a date  in  the
+// proleptic Gregorian calendar using only integer arithmetic. This
+// is the days_from_civil inverse from Howard Hinnant's "chrono-
+// Compatible Low-Level Date Algorithms", which works in 400 year
+// eras starting on March 1st so that leap days fall at the end  of
+// each year.
+struct CivilDate {
+    int64_t  year;
+    unsigned month; // 1-12
+    unsigned day;   // 1-31
+};
 
-    // Populate a tm struct with the results of converting number
-    // of  seconds  since  the  epoch  time to calendar date. The
-    // epoch time traditionally refers to UTC time zone, but this
-    // is not relevant here.
-#ifdef _WIN32
-    tm cal_time{}; gmtime_s( &cal_time, &t );
-#else
-    tm cal_time{}; gmtime_r( &t, &cal_time );
-#endif
+constexpr CivilDate civil_from_days( int64_t z ) {
+    z += 719468;
+    int64_t  era = ( z >= 0 ? z : z-146096 ) / 146097;
+    auto     doe = unsigned( z - era*146097 );               // [0, 146096]
+    unsigned yoe = ( doe - doe/1460 + doe/36524 - doe/146096 ) / 365;
+    unsigned doy = doe - ( 365*yoe + yoe/4 - yoe/100 );      // [0, 365]
+    unsigned mp  = ( 5*doy + 2 ) / 153;                      // [0, 11]
+    unsigned d   = doy - ( 153*mp + 2 )/5 + 1;
+    unsigned m   = ( mp < 10 ) ? mp+3 : mp-9;
+    int64_t  y   = int64_t( yoe ) + era*400 + ( m <= 2 ? 1 : 0 );
+    return { y, m, d };
+}
+
+static_assert( civil_from_days( 0 ).year == 1970 );
+static_assert( civil_from_days( 11016 ).month == 2 &&
+               civil_from_days( 11016 ).day   == 29 ); // 2000-02-29
+
+// Writes the n lowest decimal digits of v, zero padded.
+void put_digits( char* out, uint64_t v, int n ) {
+    for( int i = n-1; i >= 0; --i ) {
+        out[i] = char( '0' + v%10 );
+        v /= 10;
+    }
+}
+
+// Formats "YYYY-MM-DD HH:MM:SS" into out.
+void fmt_secs( char* out, int64_t secs ) {
+    constexpr int64_t secs_per_day = 24*60*60;
+    int64_t days = secs / secs_per_day;
+    int64_t rem  = secs % secs_per_day;
+    if( rem < 0 ) {
+        rem += secs_per_day;
+        --days;
+    }
+    auto [year, month, day] = civil_from_days( days );
+    ASSERT( year >= 0 && year <= 9999, "year " << year << " can"
+            "not be formatted with four digits." );
+    put_digits( out,    uint64_t( year ), 4 ); out[4]  = '-';
+    put_digits( out+5,  month,            2 ); out[7]  = '-';
+    put_digits( out+8,  day,              2 ); out[10] = ' ';
+    put_digits( out+11, uint64_t( rem/3600 ),    2 ); out[13] = ':';
+    put_digits( out+14, uint64_t( rem/60%60 ),   2 ); out[16] = ':';
+    put_digits( out+17, uint64_t( rem%60 ),      2 );
+}
+
+// The formatted date/time of the second that was most recently
+// formatted on this thread.
+struct SecondCache {
+    int64_t                           secs = numeric_limits<int64_t>::min();
+    array<char, fmt_time_secs_length> formatted{};
+};
 
-    // Place to put the  result.  Size  of  result including null
-    // zero; compute it from template  to  avoid magic numbers in
-    // code.
-    array<char, sizeof( "0000-00-00 00:00:00" )> cs{};
+thread_local SecondCache g_second_cache;
 
-    char* const start = begin( cs );
+char const* fmt_secs_cached( int64_t secs ) {
+    auto& cache = g_second_cache;
+    if( secs != cache.secs ) {
+        // If this throws then the cache is left as it was.
+        fmt_secs( cache.formatted.data(), secs );
+        cache.secs = secs;
+    }
+    return cache.formatted.data();
+}
 
-    char const* fmt = "%Y-%m-%d %H:%M:%S";
+} // namespace
 
-    // strftime() returns # of chars written not included \0.
-    ASSERT( cs.size()-1 ==
-            strftime( begin( cs ), cs.size(), fmt, &cal_time ),
-           "failed to write " << cs.size() << "chars in result "
-           "of time_t formatting" );
+// Formats  a  local  epoch  time specified in seconds in the fol-
+// lowing format: "2018-01-15 20:52:48". Strings of this form can
+// be compared lexicographically for he  purposes of comparing by
+// time ordering.
+void fmt_time_into( span<char, fmt_time_secs_length> out,
+                    seconds                          time ) {
+    memcpy( out.data(), fmt_secs_cached( time.count() ),
+            fmt_time_secs_length );
+}
 
-    return string( start, cs.size()-1 );
+string fmt_time( seconds time ) {
+    string res( fmt_time_secs_length, ' ' );
+    fmt_time_into( span<char, fmt_time_secs_length>( res ), time );
+    return res;
 }
 
 // Formats a local epoch time represented by a system clock  time
@@ -139,54 +278,255 @@ string fmt_time( seconds time ) {
 // precision then latter digits may just be  padded  with  zeroes.
 // Note that strings of  this  form  can be compared lexicographi-
 // cally to compare ordering.
+void fmt_time_into( span<char, fmt_time_length> out,
+                    system_clock::time_point const& p ) {
+    // Round down (not toward zero) so that the fraction is  never
+    // negative, even before the epoch.
+    auto secs = floor<seconds>( p );
+    nanoseconds ns = p - secs;
+
+    memcpy( out.data(), fmt_secs_cached( secs.time_since_epoch()
+                                             .count() ),
+            fmt_time_secs_length );
+    out[fmt_time_secs_length] = '.';
+    // A duration less than one second, when expressed in nanosec-
+    // onds, will always have <= 9 digits in decimal.
+    put_digits( out.data()+fmt_time_secs_length+1,
+                uint64_t( ns.count() ),
+                fmt_time_length-fmt_time_secs_length-1 );
+}
+
 string fmt_time( system_clock::time_point const& p ) {
+    string res( fmt_time_length, ' ' );
+    fmt_time_into( span<char, fmt_time_length>( res ), p );
+    return res;
+}
 
-    using namespace literals::chrono_literals;
-
-    // Get a time_t from the time_point. Note  that  time_t  will
-    // lose all sub-second resolution.
-    auto t = system_clock::to_time_t( p );
-
-    // Now convert the time_t back  to  a time_point and subtract
-    // it from the original time point,  effectively  leaving  us
-    // with  number  of  nanoseconds which were lost in the above
-    // conversion to time_t. Then we  auto  convert  it to a nano
-    // seconds type by assigning it  to  a  variable of that type
-    // explicitely. This conversion can be done without any casts
-    // because it is not a lossless  conversion (this is the case
-    // regardless of whether the total number of nanoseconds that
-    // result happen to be less than one second, which by the way
-    // happens  to be the case here, but not in general, since we
-    // can  have  an  arbitrary  quantity  of  nanoseconds  corre-
-    // sponding to a duration longer than a second).
-    nanoseconds ns = p - system_clock::from_time_t( t );
-
-    // The following is not guaranteed by the types, but we  know
-    // it must be true in this function, so do  it  as  a  sanity
-    // check.
-    ASSERT_( ns < 1s );
+/****************************************************************
+* Time parsing
+****************************************************************/
+namespace {
 
-    ostringstream ss; ss.fill( '0' );
+// The inverse of civil_from_days.
+constexpr int64_t days_from_civil( int64_t y, unsigned m,
+                                   unsigned d ) {
+    y -= ( m <= 2 ) ? 1 : 0;
+    int64_t  era = ( y >= 0 ? y : y-399 ) / 400;
+    auto     yoe = unsigned( y - era*400 );                 // [0, 399]
+    unsigned doy = ( 153*( m > 2 ? m-3 : m+9 ) + 2 )/5 + d-1; // [0, 365]
+    unsigned doe = yoe*365 + yoe/4 - yoe/100 + doy;         // [0, 146096]
+    return era*146097 + int64_t( doe ) - 719468;
+}
 
-    // These conversions are not ideal, but we have to work  with
-    // time_t unfortunately because that's how  system_clock  sup-
-    // ports outputting times.
-    seconds secs( t );
+static_assert( days_from_civil( 1970, 1, 1 ) == 0 );
+static_assert( days_from_civil( 2000, 2, 29 ) == 11016 );
+
+constexpr unsigned days_in_month( unsigned y, unsigned m ) {
+    if( m == 2 )
+        return ( y%4 == 0 && ( y%100 != 0 || y%400 == 0 ) ) ? 29 : 28;
+    return ( m == 4 || m == 6 || m == 9 || m == 11 ) ? 30 : 31;
+}
 
-    // A duration less than one second, when expressed in
-    // nanoseconds, will always have <= 9 digits in decimal.
-    constexpr size_t max_nanoseconds_digits = 9;
+// The layout of the longest fmt_time output, where a '0' stands for
+// any digit. The shorter layouts are prefixes of this one, and the
+// time zone is checked separately since its sign can vary.
+constexpr char time_layout[] = "0000-00-00 00:00:00.000000000";
+constexpr size_t time_layout_size = sizeof( time_layout ) - 1;
+static_assert( time_layout_size == fmt_time_length );
 
-    // Start with the date/time  base  which  we can extract from
-    // the time_t, then add in nanoseconds.
-    ss << fmt_time( secs ) << "."
-       << setw( max_nanoseconds_digits ) << ns.count();
+#if UTIL_SIMD_X86
+// Checks the 16 bytes at s against the 16 bytes of the layout  at
+// `layout`.
+bool matches_layout_16( char const* s, char const* layout ) {
+    auto x    = _mm_loadu_si128( (__m128i const*)s );
+    auto tmpl = _mm_loadu_si128( (__m128i const*)layout );
+    auto want_digit = _mm_cmpeq_epi8( tmpl, _mm_set1_epi8( '0' ) );
+    // Shift '0' down to -128 so that one signed comparison  tells
+    // whether a byte is a digit.
+    auto is_digit = _mm_cmplt_epi8(
+        _mm_add_epi8( x, _mm_set1_epi8( char( 0x80-'0' ) ) ),
+        _mm_set1_epi8( char( 0x80+10 ) ) );
+    auto ok = _mm_or_si128(
+        _mm_and_si128( want_digit, is_digit ),
+        _mm_andnot_si128( want_digit, _mm_cmpeq_epi8( x, tmpl ) ) );
+    return _mm_movemask_epi8( ok ) == 0xffff;
+}
+#endif
+
+// Checks that the n bytes at s (19 or 29) follow the layout.
+bool matches_layout( char const* s, size_t n ) {
+#if UTIL_SIMD_X86
+    // Two overlapping blocks cover the whole thing.
+    return matches_layout_16( s, time_layout ) &&
+           matches_layout_16( s+n-16, time_layout+n-16 );
+#else
+    bool ok = true;
+    for( size_t i = 0; i < n; ++i ) {
+        bool digit = unsigned( s[i]-'0' ) <= 9;
+        ok &= ( time_layout[i] == '0' ) ? digit
+                                        : ( s[i] == time_layout[i] );
+    }
+    return ok;
+#endif
+}
+
+unsigned digits2( char const* s ) {
+    return unsigned( s[0]-'0' )*10 + unsigned( s[1]-'0' );
+}
+
+// The value of nine digits; the first eight are combined  in  one
+// go as a little-endian integer where possible.
+uint64_t digits9( char const* s ) {
+    uint64_t v = 0;
+    if constexpr( endian::native == endian::little ) {
+        memcpy( &v, s, 8 );
+        v -= 0x3030303030303030;
+        v = ( v*10    + ( v >> 8  ) ) & 0x00ff00ff00ff00ff;
+        v = ( v*100   + ( v >> 16 ) ) & 0x0000ffff0000ffff;
+        v = ( v*10000 + ( v >> 32 ) ) & 0x00000000ffffffff;
+    } else {
+        for( int i = 0; i < 8; ++i )
+            v = v*10 + uint64_t( s[i]-'0' );
+    }
+    return v*10 + uint64_t( s[8]-'0' );
+}
 
-    string res = ss.str();
+// The last date that was converted to a day number, so that runs
+// of time stamps on the same day can skip the conversion.
+struct DayCache {
+    array<char, 10> date{};
+    int64_t         days = 0;
+    bool            valid = false;
+};
 
-    ASSERT( res.size() == 29, "formatted string " << res <<
-                              " has unexpected length." );
+// Parses the date and time in the first 19 characters of s, which
+// must already have been checked against the layout. Returns  the
+// number of seconds since the epoch.
+optional<int64_t> parse_secs( char const* s, DayCache* cache ) {
+    int64_t days;
+    if( cache && cache->valid &&
+        memcmp( s, cache->date.data(), cache->date.size() ) == 0 ) {
+        days = cache->days;
+    } else {
+        unsigned year  = digits2( s )*100 + digits2( s+2 );
+        unsigned month = digits2( s+5 );
+        unsigned day   = digits2( s+8 );
+        if( month < 1 || month > 12 || day < 1 ||
+            day > days_in_month( year, month ) )
+            return nullopt;
+        days = days_from_civil( year, month, day );
+        if( cache ) {
+            memcpy( cache->date.data(), s, cache->date.size() );
+            cache->days  = days;
+            cache->valid = true;
+        }
+    }
+    unsigned h = digits2( s+11 ), m = digits2( s+14 ),
+             sec = digits2( s+17 );
+    if( ( h > 23 ) | ( m > 59 ) | ( sec > 59 ) )
+        return nullopt;
+    return days*86400 + h*3600 + m*60 + sec;
+}
+
+// Not all years fit in a time point with nanosecond  resolution.
+// These leave room for adding the fraction of a second.
+constexpr int64_t max_sys_secs =
+    floor<seconds>( SysTimePoint::duration::max() ).count() - 1;
+constexpr int64_t min_sys_secs =
+    ceil<seconds>( SysTimePoint::duration::min() ).count() + 1;
+
+optional<SysTimePoint> parse_sys_time( string_view s,
+                                       DayCache*   cache ) {
+    if( s.size() != fmt_time_length ||
+        !matches_layout( s.data(), fmt_time_length ) )
+        return nullopt;
+    auto secs = parse_secs( s.data(), cache );
+    if( !secs || *secs > max_sys_secs || *secs < min_sys_secs )
+        return nullopt;
+    auto ns = digits9( s.data() + fmt_time_secs_length + 1 );
+    return SysTimePoint( duration_cast<SysTimePoint::duration>(
+        seconds( *secs ) + nanoseconds( ns ) ) );
+}
+
+optional<ZonedTimePoint> parse_zoned_time( string_view s,
+                                           DayCache*   cache ) {
+    constexpr size_t tz_length = sizeof( "+hhmm" ) - 1;
+    if( s.size() != fmt_time_length + tz_length )
+        return nullopt;
+    auto off = parse_tz_hhmm( s.substr( fmt_time_length ) );
+    if( !off )
+        return nullopt;
+    auto local = parse_sys_time( s.substr( 0, fmt_time_length ),
+                                 cache );
+    if( !local )
+        return nullopt;
+    // Applying the offset must not take the time point out of range.
+    int64_t utc_secs =
+        floor<seconds>( *local ).time_since_epoch().count() -
+        off->count();
+    if( utc_secs > max_sys_secs || utc_secs < min_sys_secs )
+        return nullopt;
+    return ZonedTimePoint( *local, *off );
+}
+
+template<typename T, typename ParseFunc>
+size_t parse_column( span<string_view const> in,
+                     span<optional<T>> dst, ParseFunc parse ) {
+    ASSERT( dst.size() >= in.size(), "output has size " << dst.size()
+            << " but there are " << in.size() << " inputs." );
+    DayCache cache;
+    size_t   res = 0;
+    for( size_t i = 0; i < in.size(); ++i ) {
+        dst[i] = parse( in[i], &cache );
+        res += dst[i].has_value() ? 1 : 0;
+    }
     return res;
 }
 
+} // namespace
+
+template<>
+optional<seconds> parse_time( string_view s ) {
+    if( s.size() != fmt_time_secs_length ||
+        !matches_layout( s.data(), fmt_time_secs_length ) )
+        return nullopt;
+    auto secs = parse_secs( s.data(), /*cache=*/nullptr );
+    if( !secs )
+        return nullopt;
+    return seconds( *secs );
+}
+
+template<>
+optional<SysTimePoint> parse_time( string_view s ) {
+    return parse_sys_time( s, /*cache=*/nullptr );
+}
+
+template<>
+optional<ZonedTimePoint> parse_time( string_view s ) {
+    return parse_zoned_time( s, /*cache=*/nullptr );
+}
+
+optional<TZOffset> parse_tz_hhmm( string_view s ) {
+    if( s.size() != 5 || ( s[0] != '+' && s[0] != '-' ) )
+        return nullopt;
+    for( size_t i = 1; i < 5; ++i )
+        if( unsigned( s[i]-'0' ) > 9 )
+            return nullopt;
+    unsigned h = digits2( s.data()+1 ), m = digits2( s.data()+3 );
+    if( h > 23 || m > 59 )
+        return nullopt;
+    TZOffset off = hours( h ) + minutes( m );
+    return ( s[0] == '-' ) ? -off : off;
+}
+
+size_t parse_times( span<string_view const>     in,
+                    span<optional<SysTimePoint>> out ) {
+    return parse_column( in, out, parse_sys_time );
+}
+
+size_t parse_times( span<string_view const>       in,
+                    span<optional<ZonedTimePoint>> out ) {
+    return parse_column( in, out, parse_zoned_time );
+}
+
 } // util
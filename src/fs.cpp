@@ -19,15 +19,30 @@ namespace util {
 
 namespace {
 
-void validate( fs::path const& p ) {
+// Splits the next component off of the  front  of  a  path  with
+// POSIX separators, skipping any empty ones (i.e., repeated slash-
+// es). Returns an empty view when there are none left.
+string_view next_component( string_view& rest ) {
+    auto start = rest.find_first_not_of( '/' );
+    if( start == string_view::npos ) {
+        rest = {};
+        return {};
+    }
+    rest.remove_prefix( start );
+    auto res = rest.substr( 0, rest.find( '/' ) );
+    rest.remove_prefix( res.size() );
+    return res;
+}
+
 #ifdef _WIN32
+// On POSIX there are no root names, so there is nothing to check
+// (and the functions that would call this don't).
+void validate( fs::path const& p ) {
     ASSERT( p.has_root_name() == p.has_root_directory(),
             "path " << p << " must either have both a root name "
             "and a root directory, or must have neither." );
-#else
-    (void)p;
-#endif
 }
+#endif
 
 }
 
@@ -95,6 +110,14 @@ fs::path absnormpath( fs::path const& p ) {
  */
 fs::path lexically_normal( fs::path const& p ) {
 
+#ifndef _WIN32
+    // Paths have no root names here, so the string-based  version
+    // gives the same result without rebuilding the path one compo-
+    // nent at a time.
+    string res;
+    lexically_normal_into( p.native(), res );
+    return res;
+#else
     validate( p );
 
     bool is_abs = p.is_absolute(), is_rel = p.is_relative();
@@ -157,6 +180,53 @@ fs::path lexically_normal( fs::path const& p ) {
     }
     // Result will never be empty.
     return res.empty() ? "." : res;
+#endif
+}
+
+// The same algorithm as above, but over the characters of a POSIX
+// path. The result is built up in `out` as a stack of components;
+// `n_comps` counts the components in it, of which the first
+// `n_dotdot` are ..'s (which only relative paths can have).
+string_view lexically_normal_into( string_view p, string& out ) {
+    out.clear();
+    // A path made only of slashes is left as it is, as  it  is  by
+    // lexically_normal on fs::path (e.g. "//" stays "//").
+    if( !p.empty() && p.find_first_not_of( '/' ) == string_view::npos ) {
+        out = p;
+        return out;
+    }
+    bool is_abs = !p.empty() && p[0] == '/';
+    if( is_abs )
+        out += '/';
+    size_t const root = out.size();
+    size_t n_comps = 0, n_dotdot = 0;
+    for( auto c = next_component( p ); !c.empty();
+              c = next_component( p ) ) {
+        if( c == "." )
+            continue;
+        if( c == ".." ) {
+            if( n_comps > n_dotdot ) {
+                // Remove the last component along with the slash
+                // before it (unless that slash is the root).
+                auto slash = out.rfind( '/' );
+                out.resize( ( slash == string::npos || slash < root )
+                            ? root : slash );
+                --n_comps;
+                continue;
+            }
+            if( is_abs )
+                // .. at the root is the root.
+                continue;
+            ++n_dotdot;
+        }
+        if( out.size() > root )
+            out += '/';
+        out += c;
+        ++n_comps;
+    }
+    if( out.empty() )
+        out = ".";
+    return out;
 }
 
 // This  is  like  absnormpath  except that it will not query the
@@ -222,6 +292,12 @@ fs::path lexically_absolute( fs::path const& p ) {
 fs::path lexically_relative( fs::path const& p_,
                              fs::path const& base_ ) {
 
+#ifndef _WIN32
+    string res;
+    lexically_relative_into( p_.native(), base_.native(), res );
+    return res;
+#else
+
     // These will also call validate so we don't need to here.
     fs::path p    = lexically_normal( p_    );
     fs::path base = lexically_normal( base_ );
@@ -267,6 +343,67 @@ fs::path lexically_relative( fs::path const& p_,
     // will be changed to normal form if it is empty, that way we
     // can use "empty" to mean "couldn't find solution".
     return lexically_normal( res );
+#endif
+}
+
+// The same algorithm as above, but over the characters  of  POSIX
+// paths. Because both paths are normalized first, ..'s can only ap-
+// pear at the start of a relative path  and  .'s  only  as  the
+// entire path, which lets us build the result directly in normal
+// form.
+string_view lexically_relative_into( string_view p, string_view base,
+                                     string& out ) {
+    // Reused across calls so that normalizing doesn't allocate.
+    thread_local string norm_p, norm_base;
+    string_view rest_p    = lexically_normal_into( p,    norm_p    );
+    string_view rest_base = lexically_normal_into( base, norm_base );
+
+    out.clear();
+    bool is_abs = rest_p[0] == '/';
+    if( is_abs != ( rest_base[0] == '/' ) )
+        return out;
+
+    // Skip the components that the two have in common.
+    while( true ) {
+        auto next_p    = rest_p;
+        auto next_base = rest_base;
+        auto c_p       = next_component( next_p );
+        auto c_base    = next_component( next_base );
+        if( c_p.empty() || c_base.empty() || c_p != c_base )
+            break;
+        rest_p    = next_p;
+        rest_base = next_base;
+    }
+
+    ptrdiff_t n_dd = 0, n_d = 0, dist = 0;
+    for( auto c = next_component( rest_base ); !c.empty();
+              c = next_component( rest_base ) ) {
+        ++dist;
+        n_dd += ( c == ".." );
+        n_d  += ( c == "."  );
+    }
+    // See the comment in lexically_relative  above.  The  remainder
+    // of a normalized relative base path is itself normalized, so if
+    // it has any ..'s then they survive normalization.
+    if( n_dd > 0 && !is_abs )
+        return out;
+
+    for( auto n_r = dist - 2*n_dd - n_d; n_r > 0; --n_r ) {
+        if( !out.empty() )
+            out += '/';
+        out += "..";
+    }
+    for( auto c = next_component( rest_p ); !c.empty();
+              c = next_component( rest_p ) ) {
+        if( c == "." )
+            continue;
+        if( !out.empty() )
+            out += '/';
+        out += c;
+    }
+    if( out.empty() )
+        out = ".";
+    return out;
 }
 
 // Flip any backslashes to foward slashes.
@@ -0,0 +1,169 @@
+/****************************************************************
+* Compiled glob patterns
+****************************************************************/
+#include "base-util/glob.hpp"
+
+using namespace std;
+
+namespace util {
+
+namespace {
+
+bool is_ascii_alpha( unsigned char c ) {
+    return ( c >= 'a' && c <= 'z' ) || ( c >= 'A' && c <= 'Z' );
+}
+
+// Flips the case of an ASCII letter.
+unsigned char other_case( unsigned char c ) {
+    return c ^ 0x20;
+}
+
+} // anonymous namespace
+
+Glob::Glob( string_view pattern, CaseSensitive sen )
+  : m_pattern( pattern ) {
+
+    if( sen == CaseSensitive::DEFAULT )
+        sen = CASE_INSENSITIVE_FS() ? CaseSensitive::NO
+                                    : CaseSensitive::YES;
+    m_case_sensitive = ( sen == CaseSensitive::YES );
+
+    auto add = [this]( bitset<256>& set, unsigned char c ) {
+        set.set( c );
+        if( !m_case_sensitive && is_ascii_alpha( c ) )
+            set.set( other_case( c ) );
+    };
+
+    size_t i = 0;
+    while( i < pattern.size() ) {
+        char c = pattern[i];
+        if( c == '*' ) {
+            // Consecutive stars are equivalent to one.
+            if( m_tokens.empty() || !m_tokens.back().star )
+                m_tokens.push_back( Token{ true, {} } );
+            ++i;
+            continue;
+        }
+        Token t;
+        if( c == '?' ) {
+            t.chars.set();
+            ++i;
+        } else if( c == '[' ) {
+            size_t j      = i+1;
+            bool   negate = false;
+            if( j < pattern.size() &&
+                ( pattern[j] == '!' || pattern[j] == '^' ) ) {
+                negate = true;
+                ++j;
+            }
+            // A ] straight after the opening [ is a member.
+            bool first = true;
+            while( j < pattern.size() && ( first || pattern[j] != ']' ) ) {
+                first = false;
+                auto lo = (unsigned char)pattern[j];
+                if( j+2 < pattern.size() && pattern[j+1] == '-' &&
+                    pattern[j+2] != ']' ) {
+                    auto hi = (unsigned char)pattern[j+2];
+                    for( unsigned k = lo; k <= hi; ++k )
+                        add( t.chars, (unsigned char)k );
+                    j += 3;
+                } else {
+                    add( t.chars, lo );
+                    ++j;
+                }
+            }
+            if( j < pattern.size() ) {
+                if( negate )
+                    t.chars.flip();
+                i = j+1;
+            } else {
+                // No closing ], so the [ is just a character.
+                t.chars.reset();
+                add( t.chars, '[' );
+                ++i;
+            }
+        } else {
+            add( t.chars, (unsigned char)c );
+            ++i;
+        }
+        m_tokens.push_back( t );
+    }
+
+    // The bit-parallel matcher needs a bit for each token plus one
+    // for the accepting state.
+    m_use_bits = ( m_tokens.size() < 64 );
+    if( m_use_bits ) {
+        for( size_t j = 0; j < m_tokens.size(); ++j ) {
+            auto const& t = m_tokens[j];
+            if( t.star ) {
+                m_star_mask |= uint64_t( 1 ) << j;
+                continue;
+            }
+            for( unsigned c = 0; c < 256; ++c )
+                if( t.chars.test( c ) )
+                    m_char_masks[c] |= uint64_t( 1 ) << j;
+        }
+    }
+}
+
+bool Glob::matches( string_view s ) const {
+    return m_use_bits ? matches_bits( s )
+                      : matches_backtracking( s );
+}
+
+// Bit j of the state is set if the first j tokens of the pattern
+// can match the part of the string consumed so far. A star token
+// j both loops on itself (keeps bit j) and can match nothing (so
+// bit j implies bit j+1); since consecutive stars have been  col-
+// lapsed, applying the latter once is enough.
+bool Glob::matches_bits( string_view s ) const {
+    uint64_t state = 1;
+    state |= ( state & m_star_mask ) << 1;
+    for( char c : s ) {
+        state = ( ( state & m_char_masks[(unsigned char)c] ) << 1 ) |
+                ( state & m_star_mask );
+        if( state == 0 )
+            return false;
+        state |= ( state & m_star_mask ) << 1;
+    }
+    return ( state >> m_tokens.size() ) & 1;
+}
+
+// The usual greedy algorithm: on a mismatch, go back to the most
+// recent star and let it absorb one more character.
+bool Glob::matches_backtracking( string_view s ) const {
+    size_t const n      = m_tokens.size();
+    size_t const npos   = size_t( -1 );
+    size_t       ti     = 0;
+    size_t       si     = 0;
+    size_t       star_t = npos;
+    size_t       star_s = 0;
+    while( si < s.size() ) {
+        if( ti < n && m_tokens[ti].star ) {
+            star_t = ti++;
+            star_s = si;
+        } else if( ti < n &&
+                   m_tokens[ti].chars.test( (unsigned char)s[si] ) ) {
+            ++ti;
+            ++si;
+        } else if( star_t != npos ) {
+            ti = star_t+1;
+            si = ++star_s;
+        } else {
+            return false;
+        }
+    }
+    while( ti < n && m_tokens[ti].star )
+        ++ti;
+    return ti == n;
+}
+
+PathVec Glob::filter( PathVec const& paths ) const {
+    PathVec res;
+    for( auto const& p : paths )
+        if( matches( p.filename().string() ) )
+            res.push_back( p );
+    return res;
+}
+
+} // namespace util
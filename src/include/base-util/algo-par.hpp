@@ -7,9 +7,19 @@
 #include "base-util/misc.hpp"
 
 #include <algorithm>
+#include <array>
+#include <concepts>
+#include <condition_variable>
+#include <deque>
 #include <functional>
+#include <iterator>
+#include <mutex>
+#include <optional>
+#include <ranges>
+#include <string>
 #include <thread>
 #include <type_traits>
+#include <utility>
 #include <vector>
 
 namespace util::par {
@@ -18,45 +28,204 @@ namespace util::par {
 // on this system. Result will always be >= 1.
 int max_threads();
 
-// Will take a vector of functions and will run  each  one  in  a
-// separate  thread. The functions are expected to take no parame-
-// ters  and  to  return  no values. This is a somewhat low-level
-// function that should probably not be called  except  by  other
-// functions in this module.
+/****************************************************************
+* ThreadPool
+*
+* A  fixed  set  of long-lived worker threads onto which batches
+* of  jobs  are dispatched. Creating and joining a thread per job
+* is expensive relative to small batches  of  work,  so  all  of
+* the algorithms in this module  run  on  a  pool  (by  default,
+* the  global  one  returned  by  default_pool()). Callers  that
+* want their work isolated from  the  rest  of  the  program can
+* create their own ThreadPool and pass it to the algorithms.
+****************************************************************/
+class ThreadPool {
+
+public:
+    ThreadPool( ThreadPool const& )            = delete;
+    ThreadPool& operator=( ThreadPool const& ) = delete;
+    ThreadPool( ThreadPool&& )                 = delete;
+    ThreadPool& operator=( ThreadPool&& )      = delete;
+
+    // Zero threads means use max_threads().
+    explicit ThreadPool( int threads = 0 );
+
+    // Will wait for the workers to finish whatever jobs they are
+    // currently running and then join them.
+    ~ThreadPool();
+
+    // Number of worker threads in the pool.
+    int size() const { return int( m_threads.size() ); }
+
+    // Will run each of the functions  and  block until all  have
+    // finished. The calling thread does not just sit idle  while
+    // waiting: it takes jobs from the batch  along  with  the
+    // workers. This means that it is safe  to call run() from a
+    // job that is itself running on this pool (nested  parallel-
+    // ism) without risk of deadlock. If any of the jobs throw
+    // then the first exception caught will be rethrown here after
+    // all the jobs have finished.
+    void run( std::vector<std::function<void()>> const& v );
+
+private:
+    struct Batch;
+
+    void worker();
+
+    std::mutex                        m_mutex;
+    std::condition_variable           m_cv;
+    std::deque<std::function<void()>> m_queue;
+    bool                              m_stopping{ false };
+    std::vector<std::thread>          m_threads;
+};
+
+// Sets the number of threads that the default pool will be  cre-
+// ated with (zero means max_threads(), which is the default). The
+// default pool is created lazily on first  use,  and  so  this
+// must be called before then, otherwise it will throw.
+void set_default_pool_size( int threads );
+
+// The global pool on which all of the algorithms in this  module
+// run unless they are given a pool explicitly. It is created  on
+// first use.
+ThreadPool& default_pool();
+
+// Will take a vector of functions and run them in  parallel  on
+// the given pool, returning when all have finished. The  func-
+// tions are expected to take no parameters and to return no val-
+// ues. This is a somewhat low-level function that should probably
+// not be called except by other functions in this module.
+void in_parallel( ThreadPool&                               pool,
+                  std::vector<std::function<void()>> const& v );
+
+// Same as above but runs on the default pool.
 void in_parallel( std::vector<std::function<void()>> const& v );
 
+// Selects how  the  elements  of  the  input range of a parallel
+// algorithm are divided up among the jobs.
+enum class Schedule {
+    // Each job gets a single contiguous  range  of  equal  size.
+    // This  has  the  least  overhead  and is best when each ele-
+    // ment costs about the same to process.
+    STATIC,
+    // Each job starts out owning a contiguous range of equal size
+    // which it works through in chunks that shrink as the  range
+    // is consumed; a job that runs out of work steals  the  back
+    // half of what remains in another job's range. This keeps all
+    // jobs busy when the cost per element is skewed, e.g. when a
+    // few elements take far longer than the rest.
+    STEALING
+};
+
+// Divides the index range [0, size) among `jobs` jobs running on
+// the pool according  to  the  schedule,  calling  body( job_idx,
+// start, end ) on disjoint sub-ranges [start, end) that together
+// cover the whole range. The body should return false to  signal
+// that  its  job  should  stop  (e.g.,  on  error), in which case
+// with STEALING all other jobs will stop taking  new  chunks  as
+// well. Like in_parallel, this is mainly for use by  other  func-
+// tions in this module.
+void for_ranges(
+    ThreadPool& pool, size_t size, size_t jobs, Schedule sched,
+    std::function<bool( size_t, size_t, size_t )> const& body );
+
+// The algorithms below accept  any  range  whose  elements  can be
+// reached by index in constant time and whose size is known up
+// front, e.g. vector, deque, array, span or string_view, so that
+// data does not have to be copied into a vector first. A pair of
+// random access iterators can be passed as well.
+template<typename R>
+concept ParInputRange = std::ranges::random_access_range<R const> &&
+                        std::ranges::sized_range<R const>;
+
+// Ranges that the results of an algorithm can be written into.
+template<typename R, typename T>
+concept ParOutputRange = std::ranges::random_access_range<R> &&
+                         std::ranges::sized_range<R> &&
+                         std::ranges::output_range<R, T>;
+
+// Iterator pairs accepted in place of an input range.
+template<typename It, typename Sent>
+concept ParIterators = std::random_access_iterator<It> &&
+                       std::sized_sentinel_for<Sent, It>;
+
+namespace detail {
+
+// Type of the result of calling func on an element of the range,
+// stripping away references and const.
+template<typename FuncT, typename Range>
+using Payload = std::decay_t<std::invoke_result_t<
+    FuncT&, std::ranges::range_reference_t<Range const>>>;
+
+// Number of jobs to use given what the caller asked for. Number
+// of jobs must be valid (which includes  zero),  and  zero  is
+// interpreted as a request to use all of the threads in the pool.
+inline size_t num_jobs( ThreadPool const& pool, int jobs_in ) {
+    ASSERT_( jobs_in >= 0 );
+    return (jobs_in == 0) ? size_t( pool.size() ) : size_t( jobs_in );
+}
+
+// Per-job state is padded out to this size so that jobs writing
+// to their own slots don't contend for the same cache lines.
+inline constexpr size_t cache_line_size = 64;
+
+template<typename T>
+struct alignas( cache_line_size ) CacheAligned {
+    std::optional<T> value;
+};
+
+// Runs chunk( job_idx, start, end ) over the ranges produced  by
+// for_ranges. If a chunk throws then its job stops and, after all
+// jobs have finished, the message of the first error  (in  order
+// of job index) is rethrown.
+template<typename ChunkFuncT>
+void for_ranges_rethrow( ThreadPool& pool, size_t size, size_t jobs,
+                         Schedule sched, ChunkFuncT&& chunk ) {
+    // This will hold the success/failure result from each job.
+    // nullopt means success, while a string means error.
+    std::vector<std::optional<std::string>> results( jobs );
+
+    auto body = [&]( size_t job_idx, size_t start, size_t end ) {
+        try {
+            chunk( job_idx, start, end );
+            return true;
+        } catch( std::exception const& e ) {
+            results[job_idx] = e.what();
+        } catch( ... ) {
+            results[job_idx] = "unknown exception";
+        }
+        return false; // error happened
+    };
+
+    for_ranges( pool, size, jobs, sched, body );
+
+    // Check  each  job's  results  for any errors, and re-throw
+    // the first one we find. !r means success,  and  the  ASSERT
+    // macro  is  not supposed to evaluate the second argument un-
+    // less the first one is false.
+    for( auto const& r : results ) ASSERT( !r, *r );
+}
+
+} // namespace detail
+
 /* Parallel map (returns  variants  to  capture  errors): apply a
  * function to elements in a range in parallel. This is being  im-
- * plemented until the parallel STL  becomes available. Note: the
- * range here expects to have a size() function. Each job
+ * plemented until the parallel STL  becomes available. Each  job
  * processes  its  own  chunk  of the array so as to minimize con-
- * tention between threads for the same memory. */
-template<typename FuncT, typename InputT>
-auto map_safe( FuncT                      func,
-               std::vector<InputT> const& input,
-               int                        jobs_in = 0 )
+ * tention between threads for the same memory; see the Schedule
+ * enum for how the chunks are chosen. */
+template<typename FuncT, ParInputRange Range>
+auto map_safe( ThreadPool&  pool,
+               FuncT        func,
+               Range const& input,
+               int          jobs_in = 0,
+               Schedule     sched = Schedule::STATIC )
 {
-    // Number of jobs must be valid (which includes zero).
-    ASSERT_( jobs_in >= 0 );
+    size_t jobs  = detail::num_jobs( pool, jobs_in );
+    auto   first = std::ranges::begin( input );
+    size_t size  = std::ranges::size( input );
 
-    // Interpret zero jobs as a request to use the maximum number
-    // of threads available on this system.
-    size_t jobs = (jobs_in == 0) ? max_threads() : jobs_in;
-
-    // Create one thread for  each  job,  unless  the size of the
-    // input is less than number of  requested jobs. jobs may end
-    // up  being  zero  here, and that is ok: at this point, zero
-    // jobs means that no threads will  be  spawned  and  nothing
-    // will be done (unlike jobs_in == 0 which means to  use  the
-    // max number of threads available).
-    jobs = std::min( jobs, input.size() );
-
-    // Get  the  underlying value type held by the range and then
-    // get the type of result after calling the  function  on  it,
-    // stripping away references and const.
-    using Payload = std::decay_t<decltype(
-        func( *std::begin( input ) )
-    )>;
+    using Payload = detail::Payload<FuncT, Range>;
 
     // The results of calling the function will then be held in a
     // vector of variants, the  variants  being  to  contain  any
@@ -64,146 +233,153 @@ auto map_safe( FuncT                      func,
     // throws). Copying should be  disabled  for  the elements of
     // this type, so this should  be  efficiently  moved  to  the
     // caller or, hopefully, NRVO'd.
-    std::vector<Result<Payload>> outputs( input.size() );
+    std::vector<Result<Payload>> outputs( size );
 
-    // One of the following functions will  be run in each thread.
-    auto job = [&]( size_t job_idx ) -> void {
-
-        // Divide up chunks so that threads don't contend for the
-        // same memory.
-        auto inc   = 1;
-        auto size  = input.size()/jobs;
-        auto start = job_idx*size;
-        auto end   = (job_idx == jobs-1) ? input.size()
-                                         : start+size;
-
-        for( auto i = start; i < end; i += inc ) {
+    // This will be run on each chunk of the input, storing output
+    // in the outputs array which it has captured by reference.
+    auto body = [&]( size_t, size_t start, size_t end ) {
+        for( auto i = start; i < end; ++i ) {
             try {
-                outputs[i] = func( input[i] );
+                outputs[i] = func( first[i] );
             } catch( std::exception const& e ) {
                 outputs[i] = Error{ e.what() };
             } catch( ... ) {
                 outputs[i] = Error{ "unknown exception" };
             }
         }
+        return true;
     };
 
-    // Package each job into a void(void) function  that  we  can
-    // then hand off to be executed in its own thread.
-    std::vector<std::function<void()>> funcs( jobs );
-    for( size_t i = 0; i < jobs; ++i )
-        // Each job processes indexes from  the  input  array  by
-        // starting on the index given (i), then  jumping  by  in-
-        // tervals of size jobs.
-        funcs[i] = [&job, i](){ return job( i ); };
-
-    // Run the functions in parallel. Each function will run in a
-    // single thread and will  handle  a  chunk  of the input ele-
-    // ments, storing output in  the  outputs  array which it has
-    // captured by reference.
-    in_parallel( funcs );
+    for_ranges( pool, size, jobs, sched, body );
 
     return outputs;
 }
 
-/* Parallel map (throws on error): apply a function  to  elements
- * in a range in parallel. This is being  implemented  until  the
- * parallel STL becomes available.  Note:  the range here expects
- * to  have  a size() function. Each job processes it's own chunk
- * of the array so to minimize contention between threads for the
- * same memory. */
-template<typename FuncT, typename InputT>
-auto map( FuncT                      func,
-          std::vector<InputT> const& input,
-          int                        jobs_in = 0 )
+// Same as above but runs on the default pool.
+template<typename FuncT, ParInputRange Range>
+auto map_safe( FuncT        func,
+               Range const& input,
+               int          jobs_in = 0,
+               Schedule     sched = Schedule::STATIC )
 {
-    // Number of jobs must be valid (which includes zero).
-    ASSERT_( jobs_in >= 0 );
+    return map_safe( default_pool(), std::move( func ), input,
+                     jobs_in, sched );
+}
+
+// Same as above but over a pair of iterators.
+template<typename FuncT, typename It, typename Sent>
+requires ParIterators<It, Sent>
+auto map_safe( FuncT    func,
+               It       first,
+               Sent     last,
+               int      jobs_in = 0,
+               Schedule sched = Schedule::STATIC )
+{
+    return map_safe( std::move( func ),
+                     std::ranges::subrange( first, last ),
+                     jobs_in, sched );
+}
+
+/* Parallel map into a caller-supplied range (throws  on  error):
+ * apply a function to elements in a range in  parallel,  storing
+ * the result for input[i] in output[i]. The  output  range  must
+ * be at least as large  as  the  input.  If  any  call  throws
+ * then the exception  message will be rethrown after all jobs
+ * have finished, in which case some elements of the output  may
+ * not have been written. */
+template<typename FuncT, ParInputRange Range, typename Out>
+requires ParOutputRange<Out, detail::Payload<FuncT, Range>>
+void map_into( ThreadPool&  pool,
+               FuncT        func,
+               Range const& input,
+               Out&&        output,
+               int          jobs_in = 0,
+               Schedule     sched = Schedule::STATIC )
+{
+    size_t jobs  = detail::num_jobs( pool, jobs_in );
+    auto   first = std::ranges::begin( input );
+    auto   out   = std::ranges::begin( output );
+    size_t size  = std::ranges::size( input );
+
+    ASSERT( size_t( std::ranges::size( output ) ) >= size,
+            "output range is smaller than input range ("
+            << std::ranges::size( output ) << " < " << size << ")" );
+
+    detail::for_ranges_rethrow( pool, size, jobs, sched,
+        [&]( size_t, size_t start, size_t end ) {
+            for( auto i = start; i < end; ++i )
+                out[i] = func( first[i] );
+        } );
+}
 
-    // Interpret zero jobs as a request to use the maximum number
-    // of threads available on this system.
-    size_t jobs = (jobs_in == 0) ? max_threads() : jobs_in;
-
-    // Create one thread for  each  job,  unless  the size of the
-    // input is less than number of  requested jobs. jobs may end
-    // up  being  zero  here, and that is ok: at this point, zero
-    // jobs means that no threads will  be  spawned  and  nothing
-    // will be done (unlike jobs_in == 0 which means to  use  the
-    // max number of threads available).
-    jobs = std::min( jobs, input.size() );
-
-    // Get  the  underlying value type held by the range and then
-    // get the type of result after calling the  function  on  it,
-    // stripping away references and const.
-    using Payload = std::decay_t<decltype(
-        func( *std::begin( input ) )
-    )>;
+// Same as above but runs on the default pool.
+template<typename FuncT, ParInputRange Range, typename Out>
+requires ParOutputRange<Out, detail::Payload<FuncT, Range>>
+void map_into( FuncT        func,
+               Range const& input,
+               Out&&        output,
+               int          jobs_in = 0,
+               Schedule     sched = Schedule::STATIC )
+{
+    map_into( default_pool(), std::move( func ), input,
+              std::forward<Out>( output ), jobs_in, sched );
+}
 
+/* Parallel map (throws on error): apply a function  to  elements
+ * in a range in parallel, returning the results  in  a  vector.
+ * This is being implemented until  the  parallel  STL  becomes
+ * available. Each job processes it's own chunk of the  array  so
+ * to minimize contention between threads for  the  same  memory;
+ * see the Schedule enum for how the chunks are chosen. */
+template<typename FuncT, ParInputRange Range>
+auto map( ThreadPool&  pool,
+          FuncT        func,
+          Range const& input,
+          int          jobs_in = 0,
+          Schedule     sched = Schedule::STATIC )
+{
     // The results of calling  the  function.  Elements  will  be
     // moved into place or hopefully NRVO'd; ditto for the vector
     // as a whole when returned to caller
-    std::vector<Payload> outputs( input.size() );
-
-    // This will hold the success/failure result from each
-    // thread.  nullopt means success, while a string means error.
-    std::vector<std::optional<std::string>> results( jobs );
-
-    // One of the following functions will  be run in each thread.
-    auto job = [&]( size_t job_idx ) -> void {
+    std::vector<detail::Payload<FuncT, Range>> outputs(
+        std::ranges::size( input ) );
 
-        // Divide up chunks so that threads don't contend for the
-        // same memory.
-        auto inc   = 1;
-        auto size  = input.size()/jobs;
-        auto start = job_idx*size;
-        auto end   = (job_idx == jobs-1) ? input.size()
-                                         : start+size;
+    map_into( pool, std::move( func ), input, outputs, jobs_in,
+              sched );
 
-        for( auto i = start; i < end; i += inc ) {
-            try {
-                outputs[i] = func( input[i] );
-                // If the function did  not  throw  an  exception
-                // then continue.
-                continue;
-            } catch( std::exception const& e ) {
-                results[job_idx] = e.what();
-            } catch( ... ) {
-                results[job_idx] = "unknown exception";
-            }
-            return; // error happened
-        }
-    };
+    return outputs;
+}
 
-    // Package each job into a void(void) function  that  we  can
-    // then hand off to be executed in its own thread.
-    std::vector<std::function<void()>> funcs( jobs );
-    for( size_t i = 0; i < jobs; ++i )
-        // Each job processes indexes from  the  input  array  by
-        // starting on the index given (i), then  jumping  by  in-
-        // tervals of size jobs.
-        funcs[i] = [&job, i](){ return job( i ); };
-
-    // Run the functions in parallel. Each function will run in a
-    // single thread and will  handle  a  chunk  of the input ele-
-    // ments, storing output in  the  outputs  array which it has
-    // captured by reference.
-    in_parallel( funcs );
-
-    // Check  each  thread's results for any errors, and re-throw
-    // the first one we find. !r means success,  and  the  ASSERT
-    // macro  is  not supposed to evaluate the second argument un-
-    // less the first one is false.
-    for( auto const& r : results ) ASSERT( !r, *r );
+// Same as above but runs on the default pool.
+template<typename FuncT, ParInputRange Range>
+auto map( FuncT        func,
+          Range const& input,
+          int          jobs_in = 0,
+          Schedule     sched = Schedule::STATIC )
+{
+    return map( default_pool(), std::move( func ), input, jobs_in,
+                sched );
+}
 
-    return outputs;
+// Same as above but over a pair of iterators.
+template<typename FuncT, typename It, typename Sent>
+requires ParIterators<It, Sent>
+auto map( FuncT    func,
+          It       first,
+          Sent     last,
+          int      jobs_in = 0,
+          Schedule sched = Schedule::STATIC )
+{
+    return map( std::move( func ),
+                std::ranges::subrange( first, last ), jobs_in,
+                sched );
 }
 
 /* Parallel for_each: apply a function to  elements in a range in
  * parallel. This is being implemented  until the parallel STL be-
- * comes available. Note: the range here expects to have a size()
- * function. Each job processes its own chunk of the array so  as
- * to minimize contention  between  threads  for  the same memory.
- * Unlike  map_par,  this  function  does  not  retain the return
+ * comes available. Each job processes its own chunk of the array
+ * so  as  to  minimize contention between threads  for  the same
+ * memory. Unlike map, this function does not retain the return
  * values of the function calls; i.e.,  the  functions  are  only
  * called  for  their effects. Nevertheless it will still monitor
  * the threads for exceptions, and, if any thread throws an error
@@ -213,77 +389,543 @@ auto map( FuncT                      func,
  * there is no point in trying to include all  of  them,  because
  * even  a single thread will stop processing items as soon as it
  * encounters an error). */
-template<typename FuncT, typename InputT>
-void for_each( std::vector<InputT> const& input,
-               FuncT                      func,
-               int                        jobs_in = 0 )
+template<typename FuncT, ParInputRange Range>
+void for_each( ThreadPool&  pool,
+               Range const& input,
+               FuncT        func,
+               int          jobs_in = 0,
+               Schedule     sched = Schedule::STATIC )
 {
-    // Number of jobs must be valid (which includes zero).
-    ASSERT_( jobs_in >= 0 );
+    size_t jobs  = detail::num_jobs( pool, jobs_in );
+    auto   first = std::ranges::begin( input );
+    size_t size  = std::ranges::size( input );
+
+    detail::for_ranges_rethrow( pool, size, jobs, sched,
+        [&]( size_t, size_t start, size_t end ) {
+            for( auto i = start; i < end; ++i )
+                func( first[i] );
+        } );
+}
 
-    // Interpret zero jobs as a request to use the maximum number
-    // of threads available on this system.
-    size_t jobs = (jobs_in == 0) ? max_threads() : jobs_in;
+// Same as above but runs on the default pool.
+template<typename FuncT, ParInputRange Range>
+void for_each( Range const& input,
+               FuncT        func,
+               int          jobs_in = 0,
+               Schedule     sched = Schedule::STATIC )
+{
+    for_each( default_pool(), input, std::move( func ), jobs_in,
+              sched );
+}
 
-    // Create one thread for  each  job,  unless  the size of the
-    // input is less than number of  requested jobs. jobs may end
-    // up  being  zero  here, and that is ok: at this point, zero
-    // jobs means that no threads will  be  spawned  and  nothing
-    // will be done (unlike jobs_in == 0 which means to  use  the
-    // max number of threads available).
-    jobs = std::min( jobs, input.size() );
+// Same as above but over a pair of iterators.
+template<typename FuncT, typename It, typename Sent>
+requires ParIterators<It, Sent>
+void for_each( It       first,
+               Sent     last,
+               FuncT    func,
+               int      jobs_in = 0,
+               Schedule sched = Schedule::STATIC )
+{
+    for_each( std::ranges::subrange( first, last ), std::move( func ),
+              jobs_in, sched );
+}
 
-    // This will hold the success/failure result from each
-    // thread.  nullopt means success, while a string means error.
-    std::vector<std::optional<std::string>> results( jobs );
+/* Parallel transform_reduce: apply transform to each element  of
+ * the range and combine the results, together with init,  using
+ * op, which must be associative (though not necessarily  commuta-
+ * tive). Each job folds its own contiguous chunk  into  a  partial
+ * result (held in its own cache line) and the partials are  then
+ * combined in order on the calling thread, so no temporary is
+ * created for the transformed values. Errors are propagated  in
+ * the same way as with map. */
+template<ParInputRange Range, typename T, typename OpT,
+         typename TransformT>
+T transform_reduce( ThreadPool&  pool,
+                    Range const& input,
+                    T            init,
+                    OpT          op,
+                    TransformT   transform,
+                    int          jobs_in = 0 )
+{
+    auto   first = std::ranges::begin( input );
+    size_t size  = std::ranges::size( input );
+    size_t jobs  = std::min( detail::num_jobs( pool, jobs_in ), size );
+
+    std::vector<detail::CacheAligned<T>> partials( jobs );
+
+    // Partials are indexed by job, and under the STATIC schedule
+    // job i processes the i'th chunk of the range, so combining
+    // them in order of job index preserves the order of elements.
+    detail::for_ranges_rethrow( pool, size, jobs, Schedule::STATIC,
+        [&]( size_t job_idx, size_t start, size_t end ) {
+            T acc = transform( first[start] );
+            for( auto i = start+1; i < end; ++i )
+                acc = op( std::move( acc ), transform( first[i] ) );
+            partials[job_idx].value = std::move( acc );
+        } );
+
+    for( auto& p : partials )
+        init = op( std::move( init ), std::move( *p.value ) );
+    return init;
+}
 
-    // One of the following functions will  be run in each thread.
-    auto job = [&]( size_t job_idx ) -> void {
+// Same as above but runs on the default pool.
+template<ParInputRange Range, typename T, typename OpT,
+         typename TransformT>
+T transform_reduce( Range const& input,
+                    T            init,
+                    OpT          op,
+                    TransformT   transform,
+                    int          jobs_in = 0 )
+{
+    return transform_reduce( default_pool(), input, std::move( init ),
+                             std::move( op ), std::move( transform ),
+                             jobs_in );
+}
 
-        // Divide up chunks so that threads don't contend for the
-        // same memory.
-        auto inc   = 1;
-        auto size  = input.size()/jobs;
-        auto start = job_idx*size;
-        auto end   = (job_idx == jobs-1) ? input.size()
-                                         : start+size;
+/* Parallel reduce: combine the elements of the range,  together
+ * with init, using op, which must be associative. See transform_-
+ * reduce. */
+template<ParInputRange Range, typename T, typename OpT = std::plus<>>
+T reduce( ThreadPool&  pool,
+          Range const& input,
+          T            init,
+          OpT          op = {},
+          int          jobs_in = 0 )
+{
+    return transform_reduce( pool, input, std::move( init ),
+                             std::move( op ), std::identity{},
+                             jobs_in );
+}
 
-        for( auto i = start; i < end; i += inc ) {
-            try {
-                func( input[i] );
-                // If the function was successfull then leave the
-                // corresponding result as a nullopt (which means
-                // success) and continue in the loop.
-                continue;
-            } catch( std::exception const& e ) {
-                results[job_idx] = e.what();
-            } catch( ... ) {
-                results[job_idx] = "unknown exception";
+// Same as above but runs on the default pool.
+template<ParInputRange Range, typename T, typename OpT = std::plus<>>
+T reduce( Range const& input,
+          T            init,
+          OpT          op = {},
+          int          jobs_in = 0 )
+{
+    return reduce( default_pool(), input, std::move( init ),
+                   std::move( op ), jobs_in );
+}
+
+namespace detail {
+
+// Two-pass parallel scan shared by inclusive_scan and exclusive_-
+// scan. The first pass reduces each job's chunk to  a  partial;
+// these are then scanned on the calling thread to give the value
+// carried into each chunk; the second pass scans each chunk again
+// starting from its carry. The output may alias the input since
+// each element is read before it is written in both passes.
+template<typename T, bool Inclusive, typename Range, typename Out,
+         typename OpT>
+void scan( ThreadPool& pool, Range const& input, Out& output,
+           std::optional<T> init, OpT& op, int jobs_in ) {
+    auto   first = std::ranges::begin( input );
+    auto   out   = std::ranges::begin( output );
+    size_t size  = std::ranges::size( input );
+    size_t jobs  = std::min( num_jobs( pool, jobs_in ), size );
+
+    ASSERT( size_t( std::ranges::size( output ) ) >= size,
+            "output range is smaller than input range ("
+            << std::ranges::size( output ) << " < " << size << ")" );
+
+    if( jobs == 0 )
+        return;
+
+    std::vector<CacheAligned<T>> partials( jobs );
+
+    // Pass 1. The last chunk's partial is never needed.
+    for_ranges_rethrow( pool, size, jobs, Schedule::STATIC,
+        [&]( size_t job_idx, size_t start, size_t end ) {
+            if( job_idx == jobs-1 )
+                return;
+            T acc = first[start];
+            for( auto i = start+1; i < end; ++i )
+                acc = op( std::move( acc ), first[i] );
+            partials[job_idx].value = std::move( acc );
+        } );
+
+    // Turn the partials into the value carried into each chunk.
+    // The first chunk's carry is init, which may be empty (for an
+    // inclusive scan).
+    std::optional<T> carry = std::move( init );
+    for( size_t k = 0; k < jobs; ++k ) {
+        auto&            p = partials[k].value;
+        std::optional<T> next;
+        if( k+1 < jobs )
+            next = carry ? op( *carry, std::move( *p ) )
+                         : std::move( p );
+        p     = std::move( carry );
+        carry = std::move( next );
+    }
+
+    // Pass 2.
+    for_ranges_rethrow( pool, size, jobs, Schedule::STATIC,
+        [&]( size_t job_idx, size_t start, size_t end ) {
+            std::optional<T> acc = std::move( partials[job_idx].value );
+            for( auto i = start; i < end; ++i ) {
+                if constexpr( Inclusive ) {
+                    acc = acc ? op( std::move( *acc ), first[i] )
+                              : T( first[i] );
+                    out[i] = *acc;
+                } else {
+                    T next = op( *acc, first[i] );
+                    out[i] = std::move( *acc );
+                    acc    = std::move( next );
+                }
             }
-            return; // error happened
-        }
-    };
+        } );
+}
+
+} // namespace detail
+
+/* Parallel inclusive_scan: output[i] is the result of combining
+ * input[0]..input[i] using op, which must be associative. The
+ * output range must be at least as large as the input and may be
+ * the same range as the input. This  reads  the  input  twice  so
+ * it only pays off when there is enough of it to  amortize  the
+ * extra pass over the available threads. Errors  are  propagated
+ * in the same way as with map, in which case the contents of the
+ * output are unspecified. */
+template<ParInputRange Range, typename Out, typename OpT = std::plus<>>
+requires ParOutputRange<Out, std::ranges::range_value_t<Range>>
+void inclusive_scan( ThreadPool&  pool,
+                     Range const& input,
+                     Out&&        output,
+                     OpT          op = {},
+                     int          jobs_in = 0 )
+{
+    using T = std::ranges::range_value_t<Range>;
+    detail::scan<T, true>( pool, input, output, std::nullopt, op,
+                           jobs_in );
+}
+
+// Same as above but runs on the default pool.
+template<ParInputRange Range, typename Out, typename OpT = std::plus<>>
+requires ParOutputRange<Out, std::ranges::range_value_t<Range>>
+void inclusive_scan( Range const& input,
+                     Out&&        output,
+                     OpT          op = {},
+                     int          jobs_in = 0 )
+{
+    inclusive_scan( default_pool(), input, std::forward<Out>( output ),
+                    std::move( op ), jobs_in );
+}
 
-    // Package each job into a void(void) function  that  we  can
-    // then hand off to be executed in its own thread.
+/* Parallel exclusive_scan: output[i] is the result of  combining
+ * init and input[0]..input[i-1] using op, so output[0] == init.
+ * Otherwise the same as inclusive_scan. */
+template<ParInputRange Range, typename Out, typename T,
+         typename OpT = std::plus<>>
+requires ParOutputRange<Out, T>
+void exclusive_scan( ThreadPool&  pool,
+                     Range const& input,
+                     Out&&        output,
+                     T            init,
+                     OpT          op = {},
+                     int          jobs_in = 0 )
+{
+    detail::scan<T, false>( pool, input, output,
+                            std::optional<T>( std::move( init ) ), op,
+                            jobs_in );
+}
+
+// Same as above but runs on the default pool.
+template<ParInputRange Range, typename Out, typename T,
+         typename OpT = std::plus<>>
+requires ParOutputRange<Out, T>
+void exclusive_scan( Range const& input,
+                     Out&&        output,
+                     T            init,
+                     OpT          op = {},
+                     int          jobs_in = 0 )
+{
+    exclusive_scan( default_pool(), input, std::forward<Out>( output ),
+                    std::move( init ), std::move( op ), jobs_in );
+}
+
+/****************************************************************
+* Sorting
+****************************************************************/
+namespace detail {
+
+// Inputs smaller than this are just sorted on the calling thread
+// since splitting them up would cost more than it saves.
+inline constexpr size_t serial_sort_cutoff = 8192;
+
+// Runs f( job_idx, start, end ) on `jobs` equal  chunks  of  the
+// index range [0, size), so that a later call with the same size
+// and jobs sees exactly the same chunks. If any call throws then
+// the first exception is rethrown after all jobs have finished.
+template<typename FuncT>
+void for_chunks( ThreadPool& pool, size_t size, size_t jobs,
+                 FuncT const& f ) {
     std::vector<std::function<void()>> funcs( jobs );
-    for( size_t i = 0; i < jobs; ++i )
-        // Each job processes indexes from  the  input  array  by
-        // starting on the index given (i), then  jumping  by  in-
-        // tervals of size jobs.
-        funcs[i] = [&job, i](){ return job( i ); };
-
-    // Run the functions in parallel. Each function will run in a
-    // single thread and will  handle  a  chunk  of the input ele-
-    // ments, storing success/failure in the results array  which
-    // it has captured by reference.
-    in_parallel( funcs );
-
-    // Check  each  thread's results for any errors, and re-throw
-    // the first one we find. !r means success,  and  the  ASSERT
-    // macro  is  not supposed to evaluate the second argument un-
-    // less the first one is false.
-    for( auto const& r : results ) ASSERT( !r, *r );
+    for( size_t j = 0; j < jobs; ++j )
+        funcs[j] = [&, j]{ f( j, j*size/jobs, (j+1)*size/jobs ); };
+    in_parallel( pool, funcs );
+}
+
+// Keys that can be sorted by the radix sort; they are mapped  to
+// an unsigned integer whose ordering is the same as the original.
+template<typename T>
+concept RadixKey = std::integral<T> && !std::same_as<T, bool>;
+
+template<RadixKey T>
+auto radix_key( T x ) {
+    using U = std::make_unsigned_t<T>;
+    U u = U( x );
+    // Flipping the sign bit puts negative numbers first.
+    if constexpr( std::is_signed_v<T> )
+        u ^= U( U( 1 ) << (sizeof( U )*8 - 1) );
+    return u;
+}
+
+// Parallel LSD radix sort on the unsigned key computed by key_of,
+// one byte per pass. Each pass counts the digits in each job's
+// chunk, computes where each job's elements with a given  digit
+// go, and then scatters the chunks in parallel. This is  stable,
+// and passes in which all elements have the same  digit  (e.g.
+// the high bytes of small numbers) are skipped.
+template<typename E, typename KeyOfT>
+void radix_sort( ThreadPool& pool, std::vector<E>& v, KeyOfT key_of,
+                 size_t jobs ) {
+    using U = decltype( key_of( v[0] ) );
+    constexpr size_t radix = 256;
+
+    size_t n = v.size();
+    std::vector<E> buf( n );
+    std::vector<E>* src = &v;
+    std::vector<E>* dst = &buf;
+
+    std::vector<CacheAligned<std::array<size_t, radix>>> counts( jobs );
+
+    for( size_t shift = 0; shift < sizeof( U )*8; shift += 8 ) {
+        auto digit = [&]( E const& e ) {
+            return size_t( (key_of( e ) >> shift) & (radix-1) );
+        };
+        for_chunks( pool, n, jobs,
+            [&]( size_t j, size_t start, size_t end ) {
+                auto& c = counts[j].value.emplace();
+                c.fill( 0 );
+                for( size_t i = start; i < end; ++i )
+                    ++c[digit( (*src)[i] )];
+            } );
+
+        // Turn the counts into the position in the output at which
+        // each job will write its first element with each digit.
+        bool   skip = false;
+        size_t sum  = 0;
+        for( size_t d = 0; d < radix; ++d ) {
+            size_t total = 0;
+            for( auto& c : counts ) {
+                size_t count = (*c.value)[d];
+                (*c.value)[d] = sum + total;
+                total += count;
+            }
+            if( total == n ) skip = true;
+            sum += total;
+        }
+        if( skip )
+            continue;
+
+        for_chunks( pool, n, jobs,
+            [&]( size_t j, size_t start, size_t end ) {
+                auto& pos = *counts[j].value;
+                for( size_t i = start; i < end; ++i ) {
+                    auto& e = (*src)[i];
+                    (*dst)[pos[digit( e )]++] = std::move( e );
+                }
+            } );
+        std::swap( src, dst );
+    }
+    if( src != &v )
+        v.swap( buf );
+}
+
+// Parallel merge sort: each job sorts its own chunk and then the
+// sorted runs are merged pairwise until one remains. Every merge
+// is itself split among the jobs by cutting the output at evenly
+// spaced positions and finding (by binary search along the "merge
+// path") how many elements of each run precede each cut, so that
+// the last rounds, which only have one or two merges, still  use
+// all of the threads.
+template<typename T, typename CmpT>
+void merge_sort( ThreadPool& pool, std::vector<T>& v, CmpT cmp,
+                 size_t jobs ) {
+    size_t n = v.size();
+
+    for_chunks( pool, n, jobs,
+        [&]( size_t, size_t start, size_t end ) {
+            std::sort( v.begin()+start, v.begin()+end, cmp );
+        } );
+
+    std::vector<size_t> bounds( jobs+1 );
+    for( size_t j = 0; j <= jobs; ++j )
+        bounds[j] = j*n/jobs;
+
+    std::vector<T> buf( n );
+    std::vector<T>* src = &v;
+    std::vector<T>* dst = &buf;
+
+    while( bounds.size() > 2 ) {
+        std::vector<size_t>                next_bounds{ 0 };
+        std::vector<std::function<void()>> tasks;
+        for( size_t r = 0; r+1 < bounds.size(); r += 2 ) {
+            // Merge the runs [a0, a1) and [a1, b1); if there is an
+            // odd run out at the end then it is just moved across.
+            size_t a0 = bounds[r], a1 = bounds[r+1];
+            size_t b1 = (r+2 < bounds.size()) ? bounds[r+2] : a1;
+            auto   A  = src->begin()+a0;
+            auto   B  = src->begin()+a1;
+            size_t na = a1-a0, nb = b1-a1;
+            // Number of elements of A among the first d elements
+            // of the merged output.
+            auto split = [&]( size_t d ) {
+                size_t lo = (d > nb) ? d-nb : 0;
+                size_t hi = std::min( d, na );
+                while( lo < hi ) {
+                    size_t mid = (lo+hi)/2;
+                    if( cmp( B[d-mid-1], A[mid] ) )
+                        hi = mid;
+                    else
+                        lo = mid+1;
+                }
+                return lo;
+            };
+            size_t len   = na+nb;
+            size_t parts = std::max<size_t>( 1, jobs*len/n );
+            // All cuts are found up front since the merges  move
+            // elements out of the source.
+            std::vector<size_t> cuts( parts+1 );
+            for( size_t p = 0; p <= parts; ++p )
+                cuts[p] = split( len*p/parts );
+            for( size_t p = 0; p < parts; ++p ) {
+                size_t d0 = len*p/parts, d1 = len*(p+1)/parts;
+                size_t i0 = cuts[p], i1 = cuts[p+1];
+                auto   out = dst->begin()+a0+d0;
+                tasks.push_back( [=, &cmp]{
+                    std::merge( std::make_move_iterator( A+i0 ),
+                                std::make_move_iterator( A+i1 ),
+                                std::make_move_iterator( B+(d0-i0) ),
+                                std::make_move_iterator( B+(d1-i1) ),
+                                out, cmp );
+                } );
+            }
+            next_bounds.push_back( b1 );
+        }
+        in_parallel( pool, tasks );
+        std::swap( src, dst );
+        bounds = std::move( next_bounds );
+    }
+    if( src != &v )
+        v.swap( buf );
+}
+
+} // namespace detail
+
+/* Parallel in-place sort. Integral element types are sorted with
+ * a parallel LSD radix sort, and everything else with a parallel
+ * merge sort using operator<. Small inputs, and element types that
+ * cannot be default-constructed (which the  merge  buffer  needs),
+ * are sorted with std::sort on the calling thread. Not stable. */
+template<typename T>
+void sort( ThreadPool& pool, std::vector<T>& v, int jobs_in = 0 ) {
+    size_t jobs = std::min( detail::num_jobs( pool, jobs_in ), v.size() );
+    if constexpr( std::default_initializable<T> ) {
+        if( jobs > 1 && v.size() >= detail::serial_sort_cutoff ) {
+            if constexpr( detail::RadixKey<T> )
+                detail::radix_sort( pool, v, detail::radix_key<T>, jobs );
+            else
+                detail::merge_sort( pool, v, std::less<>{}, jobs );
+            return;
+        }
+    }
+    std::sort( v.begin(), v.end() );
+}
+
+// Same as above but runs on the default pool.
+template<typename T>
+void sort( std::vector<T>& v, int jobs_in = 0 ) {
+    sort( default_pool(), v, jobs_in );
+}
+
+// Parallel in-place sort and unique.
+template<typename T>
+void uniq_sort( ThreadPool& pool, std::vector<T>& v, int jobs_in = 0 ) {
+    sort( pool, v, jobs_in );
+    v.erase( std::unique( v.begin(), v.end() ), v.end() );
+}
+
+// Same as above but runs on the default pool.
+template<typename T>
+void uniq_sort( std::vector<T>& v, int jobs_in = 0 ) {
+    uniq_sort( default_pool(), v, jobs_in );
+}
+
+/* Parallel sort_by_key: sorts the vector as if the elements were
+ * replaced with the results of calling key_func on each. key_func
+ * is called exactly once per element (in parallel) and the  keys
+ * are sorted along with the original index of each element, which
+ * is then used to move the elements into place. Since ties are
+ * broken by index the sort is stable.  Integral  keys  are  sorted
+ * with a radix sort, all others with a merge sort using the key's
+ * operator<. */
+template<typename T, typename Func>
+void sort_by_key( ThreadPool&     pool,
+                  std::vector<T>& v,
+                  Func            key_func,
+                  int             jobs_in = 0 )
+{
+    using Key = std::decay_t<std::invoke_result_t<Func&, T const&>>;
+    using Decorated = std::pair<Key, size_t>;
+
+    size_t jobs = std::min( detail::num_jobs( pool, jobs_in ), v.size() );
+    if( v.size() < 2 )
+        return;
+
+    std::vector<Decorated> decorated( v.size() );
+    detail::for_chunks( pool, v.size(), jobs,
+        [&]( size_t, size_t start, size_t end ) {
+            for( size_t i = start; i < end; ++i )
+                decorated[i] = Decorated( key_func( v[i] ), i );
+        } );
+
+    if( jobs > 1 && v.size() >= detail::serial_sort_cutoff ) {
+        if constexpr( detail::RadixKey<Key> )
+            detail::radix_sort( pool, decorated,
+                []( Decorated const& d ){
+                    return detail::radix_key( d.first );
+                }, jobs );
+        else
+            detail::merge_sort( pool, decorated, std::less<>{}, jobs );
+    } else {
+        std::sort( decorated.begin(), decorated.end() );
+    }
+
+    if constexpr( std::default_initializable<T> ) {
+        std::vector<T> res( v.size() );
+        detail::for_chunks( pool, v.size(), jobs,
+            [&]( size_t, size_t start, size_t end ) {
+                for( size_t i = start; i < end; ++i )
+                    res[i] = std::move( v[decorated[i].second] );
+            } );
+        v = std::move( res );
+    } else {
+        std::vector<T> res;
+        res.reserve( v.size() );
+        for( auto const& d : decorated )
+            res.push_back( std::move( v[d.second] ) );
+        v = std::move( res );
+    }
+}
+
+// Same as above but runs on the default pool.
+template<typename T, typename Func>
+void sort_by_key( std::vector<T>& v, Func key_func, int jobs_in = 0 ) {
+    sort_by_key( default_pool(), v, std::move( key_func ), jobs_in );
 }
 
 } // namespace util::par
@@ -4,7 +4,9 @@
 #pragma once
 
 #include "fs.hpp"
+#include "io.hpp"
 
+#include <span>
 #include <vector>
 
 namespace conv {
@@ -26,6 +28,13 @@ namespace conv {
 std::vector<char> ascii_2_utf16le( std::vector<char> const& v,
                                    bool bom = false );
 
+// Same as above but for any contiguous range of chars, e.g.  the
+// contents of a MappedFile.
+std::vector<char> ascii_2_utf16le( std::span<char const> s,
+                                   bool bom = false );
+std::vector<char> ascii_2_utf16le( util::MappedFile const& f,
+                                   bool bom = false );
+
 // Will call ascii_2_utf16le on a vector containing the  contents
 // of  the  file;  note that byte order mark (BOM) is inserted at
 // the start of the file by default. Will  throw  if  input  file
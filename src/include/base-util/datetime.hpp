@@ -6,7 +6,10 @@
 #include "base-util/types.hpp"
 
 #include <chrono>
+#include <optional>
+#include <span>
 #include <string>
+#include <string_view>
 
 namespace util {
 
@@ -21,12 +24,30 @@ namespace util {
 using TZOffset = std::chrono::seconds;
 
 // Return  the  offset in seconds from the local time zone to UTC.
-// Note that the result of this  function will be memoized for ef-
-// ficiency, so it should not be called from a process that  runs
-// for longer than a day on the day when  daylight  savings  time
-// changes (seems to to be a big deal in practice).
+// The result is memoized for efficiency, but only until the next
+// time that the offset changes (e.g. when daylight savings  time
+// starts or stops), so it remains correct in long-running  pro-
+// cesses. It is safe to call from multiple threads and does not
+// lock.
 TZOffset tz_local();
 
+namespace detail {
+
+// An offset from UTC along with the time (in seconds since the
+// epoch) until which it holds.
+struct TZWindow {
+    TZOffset             offset;
+    std::chrono::seconds valid_until;
+};
+
+// Computes the local offset in effect at time `now` and the next
+// time at which it changes, though no more than a day  ahead,  so
+// that it will be checked at least daily. This is what tz_local
+// uses to refresh its cache.
+TZWindow tz_local_window( std::chrono::seconds now );
+
+} // namespace detail
+
 // This one is to enable readability.
 inline TZOffset tz_utc() { return TZOffset( 0 ); }
 
@@ -139,6 +160,24 @@ std::string fmt_time( std::chrono::seconds time );
 // cally to compare ordering.
 std::string fmt_time( SysTimePoint const& p );
 
+// Lengths of the results of the above two overloads.
+inline constexpr size_t fmt_time_secs_length = 19;
+inline constexpr size_t fmt_time_length      = 29;
+
+// Same as fmt_time( seconds ) but writes the result into `out` (no
+// null terminator) instead of allocating a string. Throws if  the
+// year is not within 0000-9999.
+void fmt_time_into( std::span<char, fmt_time_secs_length> out,
+                    std::chrono::seconds                  time );
+
+// Same as fmt_time( SysTimePoint ) but writes the result into `out`
+// (no null terminator). Each thread keeps the formatted date  and
+// time of the last second that it formatted, so that when time
+// stamps are formatted in quick succession (e.g. in logging) only
+// the digits of the fraction of a second need to be computed.
+void fmt_time_into( std::span<char, fmt_time_length> out,
+                    SysTimePoint const&              p );
+
 // Formats a zoned time point by first adjusting its duration  ac-
 // cording  to the time zone offset given, then formatting the du-
 // ration type as a local epoch time  using one of the other fmt_-
@@ -164,6 +203,51 @@ std::string fmt_time( zt_point<DurationT> const& p,
     return fmt_time( p.to_local( off ) ) + tz_hhmm( off );
 }
 
+/****************************************************************
+* Time parsing
+****************************************************************/
+// These are the inverses of the fmt_time functions above. Each one
+// accepts exactly the layout that the corresponding fmt_time pro-
+// duces, at fixed positions and with nothing before or after it,
+// and returns nullopt if the string is not in that layout or if any
+// field is out of range (e.g. a month of 13 or Feb 30th). They do
+// not allocate.
+//
+//   parse_time<chrono::seconds>: "2018-01-15 20:52:48"
+//   parse_time<SysTimePoint>:    "2018-01-15 20:52:48.421397398"
+//   parse_time<ZonedTimePoint>:  "2018-01-15 15:52:48.421397398-0500"
+//
+// The last of these applies the offset given at the end so as  to
+// yield the absolute point in time.
+template<typename T>
+std::optional<T> parse_time( std::string_view s ) {
+    static_assert( sizeof( T ) == 0,
+                   "parse_time is not implemented for this type." );
+}
+
+template<>
+std::optional<std::chrono::seconds> parse_time( std::string_view s );
+
+template<>
+std::optional<SysTimePoint> parse_time( std::string_view s );
+
+template<>
+std::optional<ZonedTimePoint> parse_time( std::string_view s );
+
+// The inverse of tz_hhmm: parses an offset of the form (+/-)hhmm.
+std::optional<TZOffset> parse_tz_hhmm( std::string_view s );
+
+// These parse a column of time stamps, writing the result for each
+// element of `in` to the corresponding element of `out` (which must
+// be at least as long), and return the number that  were  parsed
+// successfully. Consecutive time stamps (e.g. in a log) usually fall
+// on the same day, so the date is only converted once for each run
+// of them.
+size_t parse_times( std::span<std::string_view const>     in,
+                    std::span<std::optional<SysTimePoint>> out );
+size_t parse_times( std::span<std::string_view const>       in,
+                    std::span<std::optional<ZonedTimePoint>> out );
+
 } // namespace util
 
 // For  convenience,  dump  this  two  into  the global namespace.
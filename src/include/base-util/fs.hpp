@@ -7,6 +7,8 @@
 #include "base-util/types.hpp"
 
 #include <filesystem>
+#include <string>
+#include <string_view>
 
 // Case-insensitive file system?
 #ifdef _WIN32
@@ -77,6 +79,23 @@ fs::path lexically_absolute( fs::path const& p );
 fs::path lexically_relative( fs::path const& p,
                              fs::path const& base );
 
+// String-based versions of lexically_normal and lexically_rela-
+// tive for paths in POSIX syntax (components separated by one or
+// more forward slashes, and no root names). They give the  same
+// results, but work in a single pass over the characters of  the
+// input without creating any fs::path objects. The result  is
+// written into `out` (which is cleared first, so  reusing  it
+// across calls avoids allocation) and a view of it is returned.
+// As above, an empty result from lexically_relative_into means
+// that no relative path could be determined. On POSIX the fs::path
+// versions above are implemented in terms of these.
+std::string_view lexically_normal_into( std::string_view p,
+                                        std::string&     out );
+
+std::string_view lexically_relative_into( std::string_view p,
+                                          std::string_view base,
+                                          std::string&     out );
+
 // Flip any backslashes to forward slashes.
 std::string fwd_slashes( std::string_view in );
 
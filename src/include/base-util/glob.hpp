@@ -0,0 +1,89 @@
+/****************************************************************
+* Compiled glob patterns
+****************************************************************/
+#pragma once
+
+#include "base-util/fs.hpp"
+#include "base-util/types.hpp"
+
+#include <array>
+#include <bitset>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace util {
+
+/****************************************************************
+* Glob
+*
+* A shell-style glob pattern that is compiled once  and  can  then
+* be matched against any number of strings (typically file names).
+* The pattern must match the entire string. Supported syntax:
+*
+*   *        any sequence of characters, including none.
+*   ?        any single character.
+*   [abc]    any one of the characters listed; ranges such as  a-z
+*            are allowed, and a ] or - can be included by  listing
+*            it first (or, for -, last).
+*   [!abc]   any one character that is not listed; [^abc] is  the
+*   [^abc]   same.
+*
+* Any other character (including a [ with no closing ]) matches
+* itself. There are no escapes, since \ is a path separator on
+* some platforms. By default matching is case-insensitive only on
+* platforms with case-insensitive file systems (CASE_INSENSITIVE_-
+* FS()), in which case ASCII letters are compared without regard
+* to case.
+*
+* Matching does not allocate and runs in time linear in the length
+* of the string for patterns with up  to  63  characters  (not
+* counting repeated *'s), by simulating all possible  positions
+* in the pattern at once in the bits of a  word.  Longer  patterns
+* fall back to a backtracking matcher.
+****************************************************************/
+class Glob {
+
+public:
+    explicit Glob( std::string_view pattern,
+                   CaseSensitive sen = CaseSensitive::DEFAULT );
+
+    bool matches( std::string_view s ) const;
+
+    bool operator()( std::string_view s ) const {
+        return matches( s );
+    }
+
+    // Returns those paths whose file names match the pattern, in
+    // the same order.
+    PathVec filter( PathVec const& paths ) const;
+
+    std::string const& pattern() const { return m_pattern; }
+
+    bool case_sensitive() const { return m_case_sensitive; }
+
+private:
+    // One element of the compiled pattern: either a * or a  single
+    // character drawn from a set.
+    struct Token {
+        bool              star{ false };
+        std::bitset<256>  chars;
+    };
+
+    bool matches_bits( std::string_view s ) const;
+    bool matches_backtracking( std::string_view s ) const;
+
+    std::string        m_pattern;
+    bool               m_case_sensitive;
+    std::vector<Token> m_tokens;
+
+    // For the bit-parallel matcher: bit j of m_char_masks[c]  is
+    // set if token j is not a star and accepts char c; bit  j  of
+    // m_star_mask is set if token j is a star.
+    bool                          m_use_bits{ false };
+    std::array<uint64_t, 256>     m_char_masks{};
+    uint64_t                      m_star_mask{ 0 };
+};
+
+} // namespace util
@@ -6,19 +6,182 @@
 #include "base-util/fs.hpp"
 #include "base-util/types.hpp"
 
+#include <functional>
+#include <iterator>
 #include <optional>
+#include <span>
+#include <string_view>
+#include <vector>
 
 namespace util {
 
+/****************************************************************
+* MappedFile
+*
+* Read-only view of the entire contents of a file. Regular files
+* are  memory  mapped,  so  that  nothing  is  copied  and pages
+* are only brought in as they are touched;  anything  else  (pipes,
+* character devices, files in /proc that  report  a  size of zero,
+* and all files on Windows) is read into a buffer instead. Either
+* way the contents are exposed as a contiguous range of chars that
+* remains valid for the lifetime of the object.
+****************************************************************/
+class MappedFile {
+
+public:
+    // Will throw if the file cannot be opened or read.
+    explicit MappedFile( fs::path const& p );
+
+    // Same as above but returns nullopt if the file cannot be
+    // opened (it will still throw if it can be opened but then
+    // cannot be read).
+    static std::optional<MappedFile> open( fs::path const& p );
+
+    ~MappedFile();
+
+    MappedFile( MappedFile const& )            = delete;
+    MappedFile& operator=( MappedFile const& ) = delete;
+
+    MappedFile( MappedFile&& other ) noexcept;
+    MappedFile& operator=( MappedFile&& other ) noexcept;
+
+    char const* data() const {
+        return m_mapped ? m_data : m_buffer.data();
+    }
+    size_t size()  const { return m_size; }
+    bool   empty() const { return m_size == 0; }
+
+    // Whether the contents are mapped, as opposed to having  been
+    // read into a buffer.
+    bool is_mapped() const { return m_mapped; }
+
+    std::span<char const> span() const { return { data(), m_size }; }
+    std::string_view      view() const { return { data(), m_size }; }
+
+    char const* begin() const { return data(); }
+    char const* end()   const { return data() + m_size; }
+
+private:
+    MappedFile() = default;
+
+    // Returns false if the file could not be opened.
+    bool load( fs::path const& p );
+    void reset();
+
+    char const*       m_data{ nullptr };
+    size_t            m_size{ 0 };
+    bool              m_mapped{ false };
+    std::vector<char> m_buffer;
+};
+
 // Read  a  file in its entirety into a vector of chars. This may
 // be a bit less efficient than possible because the vector, when
 // created, will initialize all of its bytes  to  zero  which  we
 // don't actually need.
 std::vector<char> read_file( fs::path const& p );
 
+/****************************************************************
+* LineReader
+*
+* Reads a text file (or any file descriptor, e.g. a pipe) line by
+* line in large blocks. Lines are yielded as string_views into an
+* internal buffer that is reused, so no allocation is done per line
+* and only about one block of the file is resident at a time; the
+* views are only valid until the reader is next advanced. A  line
+* that spans the end of a block is moved to the front of the buf-
+* fer (which grows if the line is longer than a block). As  with
+* getline, the newline is not included in the line and a final
+* newline does not start a new (empty) line. A CR immediately
+* before a newline is also removed (so CRLF and LF files  yield
+* the same lines, consistent with dos2unix); any other CRs  are
+* left alone. Usage:
+*
+*   for( string_view line : util::LineReader( "file.txt" ) )
+*       ...
+****************************************************************/
+class LineReader {
+
+public:
+    static constexpr size_t default_block_size = 1 << 18;
+
+    // Will throw if the file cannot be opened.
+    explicit LineReader( fs::path const& p,
+                         size_t block_size = default_block_size );
+
+    // Reads from an already-open file  descriptor,  which  is  not
+    // closed by the reader.
+    explicit LineReader( int fd,
+                         size_t block_size = default_block_size );
+
+    ~LineReader();
+
+    // Iterators hold a pointer to the reader.
+    LineReader( LineReader const& )            = delete;
+    LineReader& operator=( LineReader const& ) = delete;
+
+    // Returns the next line, or nullopt at the end of the  file.
+    // Throws if reading fails.
+    std::optional<std::string_view> next();
+
+    class iterator {
+
+    public:
+        using value_type       = std::string_view;
+        using difference_type  = std::ptrdiff_t;
+        using iterator_concept = std::input_iterator_tag;
+
+        iterator() = default;
+
+        std::string_view operator*() const { return m_line; }
+
+        iterator& operator++() { advance(); return *this; }
+        void      operator++( int ) { advance(); }
+
+        friend bool operator==( iterator const& it,
+                                std::default_sentinel_t ) {
+            return it.m_reader == nullptr;
+        }
+
+    private:
+        friend class LineReader;
+
+        explicit iterator( LineReader* r ) : m_reader( r ) {
+            advance();
+        }
+
+        void advance();
+
+        LineReader*      m_reader{ nullptr };
+        std::string_view m_line;
+    };
+
+    // Can only be iterated once; iteration starts from wherever
+    // the reader currently is.
+    iterator                begin() { return iterator( this ); }
+    std::default_sentinel_t end()   { return {}; }
+
+private:
+    // Moves the unconsumed part of the buffer to the front  and
+    // reads more data after it. Returns false at end of file.
+    bool fill();
+
+    int               m_fd{ -1 };
+    bool              m_owns_fd{ false };
+    bool              m_eof{ false };
+    std::vector<char> m_buf;
+    // The unconsumed data is [m_pos, m_end), and we know that there
+    // is no newline in [m_pos, m_scan).
+    size_t            m_pos{ 0 };
+    size_t            m_scan{ 0 };
+    size_t            m_end{ 0 };
+};
+
 // Open the file, truncate it,  and  write  given  vector  to  it.
 void write_file( fs::path const& p, std::vector<char> const& v );
 
+// Same as above but for any contiguous range of bytes.
+void write_file( fs::path const& p, std::span<char const> s );
+
 // We should not need this function  because  the  filesystem  li-
 // brary provides fs::copy_file which would ideally be better  to
 // use. However, it was observed at  the  time  of  this  writine
@@ -30,19 +193,26 @@ void write_file( fs::path const& p, std::vector<char> const& v );
 // function which will copy the file in  binary  mode  faithfully.
 void copy_file( fs::path const& from, fs::path const& to );
 
-// Read a text file into a string in its entirety.
+// Read a text file into a string in its entirety. A single final
+// newline, if present, is not included.
 std::optional<std::string>
 read_file_as_string( fs::path const& p );
 
+// Same as above but from a file that is already open.
+std::string read_file_as_string( MappedFile const& f );
+
 // Read  a text file into a string in its entirety and then split
 // it into lines.
 StrVec read_file_lines( fs::path const& p );
 
+// Same as above but from a file that is already open.
+StrVec read_file_lines( MappedFile const& f );
+
 // Take a path whose last  component  (file name) contains a glob
 // expression and  return  results  by  searching  the  directory
 // listing for all files (and folders if flag is true) that match
-// the glob pattern. Only *  and  ?  are supported, and those spe-
-// cial  characters  can only appear in the file name of the path.
+// the glob pattern (see util::Glob for the syntax), whose special
+// characters can only appear in the file name of the path.
 // The filename (with wildcard characters)  must match the entire
 // file name from start to finish. If one of the folders  in  the
 // path  does  not  exist, an exception is thrown. If the path is
@@ -54,4 +224,27 @@ StrVec read_file_lines( fs::path const& p );
 // names begin with a dot ("hidden files" on Linux).
 PathVec wildcard( fs::path const& p, bool with_folders = true );
 
+// Like wildcard, but any component of the path may  contain  glob
+// characters, and a component consisting of ** matches  zero  or
+// more directories; e.g. "src/**/*.cpp" finds all .cpp files  at
+// any depth under src. The tree is walked in parallel by `jobs`
+// jobs on the default thread pool (zero means all of its threads).
+// Symlinks are not followed, though (as in wildcard) a symlink to
+// a folder counts as a folder for the purposes of with_folders.
+// Results are sorted. Throws  if  the leading non-wildcard part of
+// the path is not an existing folder.
+PathVec wildcard_recursive( fs::path const& p,
+                            bool with_folders = true,
+                            int  jobs = 0 );
+
+// Same as above but, instead of collecting the results, passes each
+// matching path to the callback as soon as it is found. The call-
+// back is called under a lock (so it need not be thread safe) but
+// in no particular order.
+void for_each_wildcard(
+        fs::path const&                               p,
+        std::function<void( fs::path const& )> const& on_match,
+        bool with_folders = true,
+        int  jobs = 0 );
+
 } // namespace std
@@ -4,13 +4,45 @@
 #pragma once
 
 #include "base-util/algo.hpp"
+#include "base-util/error.hpp"
 #include "base-util/fs.hpp"
+#include "base-util/io.hpp"
 #include "base-util/misc.hpp"
 
+#include <iterator>
+#include <span>
+#include <string_view>
 #include <vector>
 
 namespace util {
 
+/****************************************************************
+* Kernels on raw spans of chars
+*
+* These are vectorized (SSE2, or AVX2 when the CPU supports it,
+* selected at runtime) with a scalar fallback, and are what  the
+* container and file versions below are built on.
+****************************************************************/
+// Copies  `in`  to  `out`  with  all  0x0D  characters  removed,
+// returning the number of chars written. `out` must have room for
+// in.size() chars, and may be equal to in.data() (in which case
+// the removal is done in place), but must not otherwise overlap.
+size_t dos2unix_span( std::span<char const> in, char* out );
+
+// Returns  the  number  of  chars that unix2dos_span will  write
+// for the given input, i.e. the size of the input plus the number
+// of  0x0A characters that are not preceded by 0x0D. `prev` is the
+// char that precedes the input, if any, so that a  CRLF  pair
+// split across two spans is recognized; zero means none.
+size_t unix2dos_size( std::span<char const> in, char prev = 0 );
+
+// Copies `in` to `out` inserting a 0x0D before any  0x0A  that  is
+// not already preceded by one (see unix2dos_size for `prev`), and
+// returns the number of chars written. `out` must have room  for
+// unix2dos_size( in, prev ) chars and must not overlap the input.
+size_t unix2dos_span( std::span<char const> in, char* out,
+                      char prev = 0 );
+
 // This function will simply remove and 0x0D characters from  the
 // input  (mutating  the argument). The new size of the container
 // will therefore always be less or equal to  its  original  size.
@@ -19,7 +51,14 @@ void dos2unix( Container& c,
     std::enable_if_t<std::is_same_v<
         typename Container::iterator::value_type, char>>*
             /*unused*/ = nullptr ) {
-    util::remove_if( c, []( auto const& _ ){ return _ == 0x0d; } );
+    if constexpr( std::contiguous_iterator<
+                      typename Container::iterator> ) {
+        size_t size = dos2unix_span(
+            { std::data( c ), std::size( c ) }, std::data( c ) );
+        c.erase( std::begin( c ) + size, std::end( c ) );
+    } else {
+        util::remove_if( c, []( auto const& _ ){ return _ == 0x0d; } );
+    }
 }
 
 // This  function  will  simply search for any 0x0A character and
@@ -38,19 +77,30 @@ void unix2dos( Container& in,
         typename Container::iterator::value_type, char>>*
             /*unused*/ = nullptr ) {
 
-    // Some quick experiments suggest that the average ascii text
-    // file will grow about 3-4% in size after this operation, so
-    // we will reserve an additional 5%  to  try to avoid an addi-
-    // tional allocation.  However,  this  is  of  course  just a
-    // heuristic which will not be optimal or even helpful in all
-    // cases.
-    constexpr size_t denominator{20}; // 1/20 == 5%
-    size_t estimate = in.size() + (in.size() / denominator);
-    Container out; out.reserve( estimate );
+    if constexpr( std::contiguous_iterator<
+                      typename Container::iterator> ) {
+        std::span<char const> s( std::data( in ), std::size( in ) );
+        // A counting pass gives the exact size of the output.
+        size_t size = unix2dos_size( s );
+        if( size == s.size() )
+            return; // nothing to change.
+        Container out( size, char( 0 ) );
+        unix2dos_span( s, std::data( out ) );
+        in = std::move( out );
+        return;
+    }
 
     constexpr char LF = 0x0A;
     constexpr char CR = 0x0D;
 
+    size_t size = in.size();
+    for( auto i = std::begin( in ); i != std::end( in ); ++i )
+        if( *i == LF && ( i == std::begin( in ) || *(i-1) != CR ) )
+            ++size;
+    Container out;
+    if constexpr( requires { out.reserve( size ); } )
+        out.reserve( size );
+
     for( auto i = std::begin( in ); i != std::end( in ); ++i ) {
         if( *i == LF ) {
             // We have encountered an  LF character, so therefore
@@ -67,6 +117,12 @@ void unix2dos( Container& in,
     in = std::move( out );
 }
 
+// Same as the container versions  above  but  read from a mapped
+// file (which can't be mutated), returning the result in  a  new
+// vector.
+std::vector<char> dos2unix( MappedFile const& f );
+std::vector<char> unix2dos( MappedFile const& f );
+
 // Open the given path and edit  it to remove all 0x0D characters.
 // This  attempts to emulate the command line utility of the same
 // name.  As  with  the  command,  the  `keepdate` flag indicates
@@ -74,6 +130,13 @@ void unix2dos( Container& in,
 // default, the timestamp will be  touched  if any changes to the
 // file are made. Bool return value indicates  whether  file  con-
 // tents were changed or not (regardless of timestamp).
+//
+// Both this and unix2dos below stream  through  the  file  in
+// fixed-size blocks, so memory use does not depend on  the  size
+// of the file. A file that needs no changes is not  written  at
+// all; otherwise the new contents are written to  a  temporary
+// file in the same folder which then replaces the  original  (by
+// rename), so a crash part-way through leaves the original intact.
 bool dos2unix( fs::path const& p, bool keepdate = false );
 
 // Open  the given path and edit it to change LF to CRLF. This at-
@@ -88,4 +151,40 @@ bool dos2unix( fs::path const& p, bool keepdate = false );
 // stamp).
 bool unix2dos( fs::path const& p, bool keepdate = false );
 
+/****************************************************************
+* Batch Conversion
+*
+* These run the path versions of dos2unix/unix2dos above on many
+* files in parallel, collecting the result for each file (whether
+* it was changed, or the error that occurred) rather than stopping
+* at the first failure. `jobs` bounds the number of files that are
+* being converted at any one time, which bounds  both  the  I/O
+* concurrency and the memory used; zero means the  size  of  the
+* default thread pool, capped at `default_io_jobs`.
+****************************************************************/
+inline constexpr int default_io_jobs = 8;
+
+// Results are in the same order as the input paths, which should
+// not contain duplicates (the same file must not be converted
+// twice at the same time).
+std::vector<Result<bool>> dos2unix( PathVec const& paths,
+                                    bool keepdate = false,
+                                    int  jobs = 0 );
+std::vector<Result<bool>> unix2dos( PathVec const& paths,
+                                    bool keepdate = false,
+                                    int  jobs = 0 );
+
+// Converts all regular files under `root` (recursively) whose file
+// names match the glob pattern, which supports the same syntax as
+// util::wildcard. Symlinks are not followed (nor converted).  The
+// results are sorted by path. Throws if the tree can't be walked.
+PairVec<fs::path, Result<bool>> dos2unix_tree( fs::path const& root,
+                                               std::string_view glob,
+                                               bool keepdate = false,
+                                               int  jobs = 0 );
+PairVec<fs::path, Result<bool>> unix2dos_tree( fs::path const& root,
+                                               std::string_view glob,
+                                               bool keepdate = false,
+                                               int  jobs = 0 );
+
 }
@@ -5,34 +5,124 @@
 
 #include "string.hpp"
 
+#include <optional>
 #include <string>
 #include <string_view>
+#include <tuple>
 
 namespace net {
 
-// URL-encode a string.
+// URL-encode a string. Letters, digits and any of -_.~ are  kept
+// as they are (regardless of locale) and all other bytes are per-
+// cent-encoded with upper case hex digits.
 std::string url_encode( std::string_view in );
 
+// Same as above but appends the result to `out`, which is grown
+// exactly once to the final size.
+void url_encode_into( std::string& out, std::string_view in );
+
+// The size of the result of url-encoding `in`.
+size_t url_encoded_size( std::string_view in );
+
+// Reverses url_encode: each %XX (either case) is replaced with the
+// byte that it encodes and everything else is left as it is (in-
+// cluding '+'). Returns nullopt if there is a % that is not  fol-
+// lowed by two hex digits.
+std::optional<std::string> url_decode( std::string_view in );
+
+// Same as above but appends the result to `out`. Returns false and
+// leaves `out` as it was if the input is malformed.
+bool url_decode_into( std::string& out, std::string_view in );
+
+namespace detail {
+
+// Writes the url-encoding of `in` to dst, which must have room for
+// url_encoded_size( in ) bytes plus two more, and returns the end
+// of what was written. The two extra bytes may be overwritten.
+char* url_encode_to( char* dst, std::string_view in );
+
+} // namespace detail
+
 // This function will accept some kind  of range / container that
-// will yield either pairs or 2-tuples of strings. It  will  then
-// url-encode  each  key/value pair, join each pair with an equal
-// sign, then join the pairs with &.  E.g., result is of the form
-// A=B&C=D&E=F.
+// will yield either pairs or 2-tuples of strings (or anything else
+// convertible to string_view). It  will  then url-encode  each
+// key/value pair, join each pair with an equal sign, then join the
+// pairs with &, appending the result to `out`. E.g., result is of
+// the form A=B&C=D&E=F. The size of the result is computed first so
+// that each key and value is encoded directly into its final place.
 template<typename KeyValT>
-std::string url_encode_kv( KeyValT const& kv ) {
+void url_encode_kv_into( std::string& out, KeyValT const& kv ) {
+    auto key = []( auto const& p ) {
+        return std::string_view( std::get<0>( p ) );
+    };
+    auto val = []( auto const& p ) {
+        return std::string_view( std::get<1>( p ) );
+    };
 
-    std::vector<std::string> terms( kv.size() );
+    size_t size  = 0;
+    bool   first = true;
+    for( auto const& p : kv ) {
+        size += ( first ? 0 : 1 ) + url_encoded_size( key( p ) ) + 1 +
+                url_encoded_size( val( p ) );
+        first = false;
+    }
 
-    auto encode_pair = []( auto const& p ) {
-        return url_encode( std::get<0>( p ) ) + '=' +
-               url_encode( std::get<1>( p ) );
+    size_t old = out.size();
+    // Two extra bytes for url_encode_to to write past the end.
+    out.resize( old + size + 2 );
+    char* dst = out.data() + old;
+    first = true;
+    for( auto const& p : kv ) {
+        if( !first )
+            *dst++ = '&';
+        first  = false;
+        dst    = detail::url_encode_to( dst, key( p ) );
+        *dst++ = '=';
+        dst    = detail::url_encode_to( dst, val( p ) );
+    }
+    out.resize( old + size );
+}
+
+// Same as above but returns the result.
+template<typename KeyValT>
+std::string url_encode_kv( KeyValT const& kv ) {
+    std::string res;
+    url_encode_kv_into( res, kv );
+    return res;
+}
+
+// Goes through the key/value pairs of a query string of the  form
+// A=B&C=D&E=F, url-decoding each key and value. A key and/or value
+// that contains no escapes is returned as a view into the query
+// string itself, so that nothing is copied; the others are decoded
+// into buffers held by the parser, and so those views are only
+// valid until the next call to next(). As with url_decode, a '+'
+// is left as it is. Empty terms (e.g. between && ) are skipped and
+// a term with no = has an empty value. Throws if a term  contains
+// a malformed escape.
+//
+//   net::QueryParser parser( "a=1&b=x%20y" );
+//   while( auto param = parser.next() )
+//       use( param->key, param->value );
+//
+class QueryParser {
+public:
+    struct Param {
+        std::string_view key;
+        std::string_view value;
     };
 
-    // Encode each key/value pair.
-    std::transform( std::begin( kv ),    std::end( kv ),
-                    std::begin( terms ), encode_pair );
+    explicit QueryParser( std::string_view query );
 
-    return util::join( terms, "&" );
-}
+    // Returns nullopt when there are no more pairs.
+    std::optional<Param> next();
+
+private:
+    std::string_view decode( std::string_view in, std::string& buf );
+
+    std::string_view m_rest;
+    std::string      m_key_buf;
+    std::string      m_value_buf;
+};
 
 } // namespace net
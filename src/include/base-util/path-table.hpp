@@ -0,0 +1,166 @@
+/****************************************************************
+* Interned paths
+****************************************************************/
+#pragma once
+
+#include "base-util/fs.hpp"
+#include "base-util/types.hpp"
+
+#include <cstdint>
+#include <deque>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace util {
+
+// Handle to a path interned in a PathTable. It is only meaningful
+// together with the table that issued it.
+enum class PathId : uint32_t {};
+
+/****************************************************************
+* PathTable
+*
+* Stores a set of paths as a tree in which each node is a (parent,
+* component) pair, so that paths sharing a prefix share the nodes
+* for it, and each distinct component string  is  stored  only
+* once. Paths are interned in lexically normal form, so two paths
+* get the same handle if and only if they  are  lexically  equal
+* after normalization, and comparing them  is  an  integer  com-
+* parison. Each node also records its ancestors, so that  prefix
+* tests take constant time, and  the  handle  of  its  case-folded
+* form, so that case-insensitive comparison does too. The folded
+* forms are stored as nodes as well, but unless they have been in-
+* terned in their own right they are not visible through find  or
+* counted by size. Paths are only turned back into fs::path objects
+* on request.
+*
+* Interning is not thread safe, but once a table is  built  any
+* number of threads can query it.
+****************************************************************/
+class PathTable {
+
+public:
+    // The handle of the path ".", which is the normal form  of  the
+    // empty path. It is always present.
+    static constexpr PathId dot{ 0 };
+
+    PathTable();
+
+    // Returns the handle for the (lexically normalized) path,  add-
+    // ing it to the table if it is not already there.
+    PathId intern( fs::path const& p );
+
+    // Returns the handle for the path consisting of `parent` fol-
+    // lowed by one more component, which must be a single  file
+    // name (and not . or ..).
+    PathId child( PathId parent, std::string_view component );
+
+    // Returns the handle for the path if it has been interned (or
+    // is a prefix of one that has).
+    std::optional<PathId> find( fs::path const& p ) const;
+
+    fs::path to_path( PathId id ) const;
+
+    // The last component of the path; empty for ".".
+    std::string_view filename( PathId id ) const;
+
+    // The path with its last component removed. The parent of a
+    // path that is just a root (e.g. "/") is itself, as is the
+    // parent of "." (and the parent of a relative path with  one
+    // component is ".").
+    PathId parent( PathId id ) const;
+
+    // Number of components, counting a root directory (or a root
+    // name) as one; zero for ".".
+    size_t depth( PathId id ) const;
+
+    bool is_absolute( PathId id ) const;
+
+    // True if the components of `prefix` are a prefix of those of
+    // `id` (or they are equal). "." is a prefix of all relative
+    // paths.
+    bool starts_with( PathId id, PathId prefix ) const;
+
+    // The ancestor of the path with the given depth, which must  be
+    // no greater than that of the path.
+    PathId ancestor( PathId id, size_t depth ) const;
+
+    // The handle of the path with all of  its  ASCII  letters  con-
+    // verted to lower case. Two paths compare equal  case-insensi-
+    // tively if and only if their folded handles are equal.  The
+    // folded path itself need not have been interned.
+    PathId folded( PathId id ) const { return node( id ).folded; }
+
+    // Number of distinct paths (including ".") and components that
+    // have been interned, not counting those  that  are  only  the
+    // folded forms of others.
+    size_t size() const { return m_num_paths; }
+    size_t num_components() const { return m_num_components; }
+
+private:
+    friend std::optional<PathId> lexically_relative( PathTable& table,
+                                                     PathId     p,
+                                                     PathId     base );
+
+    struct Node {
+        uint32_t parent;
+        uint32_t component;
+        uint32_t depth;
+        // Offset into m_ancestors of this node's list of ancestors
+        // (indexed by depth-1, and ending with the node itself).
+        uint32_t ancestors;
+        PathId   folded;
+        bool     root;
+        bool     absolute;
+        // False for nodes that are only there as  the  folded  form
+        // of others.
+        bool     interned;
+    };
+
+    Node const& node( PathId id ) const;
+
+    uint32_t intern_component( std::string_view s );
+    std::optional<uint32_t> find_component( std::string_view s ) const;
+
+    PathId add_child( PathId parent, uint32_t component, bool root,
+                      bool interned = true );
+
+    // Marks the node and its ancestors as interned.
+    void mark_interned( uint32_t id );
+
+    static uint64_t child_key( PathId parent, uint32_t component ) {
+        return ( uint64_t( parent ) << 32 ) | component;
+    }
+
+    // Components are stored in a deque so that the views used as
+    // keys in the map remain valid as more are added.
+    std::deque<std::string>                        m_components;
+    std::unordered_map<std::string_view, uint32_t> m_component_ids;
+    // Whether each component is used by an interned node.
+    std::vector<bool>                              m_component_used;
+
+    std::vector<Node>                      m_nodes;
+    std::vector<uint32_t>                  m_ancestors;
+    std::unordered_map<uint64_t, uint32_t> m_children;
+
+    size_t m_num_paths      = 0;
+    size_t m_num_components = 0;
+};
+
+// Handle-based version of path_equals  (see  fs.hpp),  with  the
+// same default for case sensitivity. Both handles must come  from
+// the given table.
+bool path_equals( PathTable const& table, PathId a, PathId b,
+                  CaseSensitive sen = CaseSensitive::DEFAULT );
+
+// Handle-based version of lexically_relative (see fs.hpp), which
+// gives the same results, except that where that returns an empty
+// path to signal that there is no answer this returns nullopt. The
+// result is interned in the table if it is not already there.
+std::optional<PathId> lexically_relative( PathTable& table, PathId p,
+                                          PathId base );
+
+} // namespace util
@@ -8,13 +8,18 @@
 #include "base-util/misc.hpp"
 #include "base-util/types.hpp"
 
+#include <array>
 #include <cctype>
 #include <charconv>
+#include <cstdint>
 #include <filesystem>
+#include <iterator>
 #include <optional>
+#include <ranges>
 #include <string>
 #include <string_view>
 #include <tuple>
+#include <type_traits>
 #include <utility>
 #include <variant>
 #include <vector>
@@ -32,10 +37,30 @@ bool starts_with( std::string_view s, std::string_view what );
 // Returns true if s ends with what.
 bool ends_with( std::string_view s, std::string_view what );
 
+// Case-insensitive versions of the above,  with  case  folded  in
+// the same way as iequals.
+bool icontains( std::string_view s, std::string_view what );
+bool istarts_with( std::string_view s, std::string_view what );
+bool iends_with( std::string_view s, std::string_view what );
+
+namespace detail {
+
+// Implementation of iequals for narrow strings. This folds the case
+// of ASCII letters many bytes at a time and only falls back  to
+// comparing characters  one  at  a  time  with  std::tolower  from
+// the first position at which the two differ after that, so that
+// non-ASCII bytes are treated as before.
+bool iequals_narrow( std::string_view s1, std::string_view s2 );
+
+} // namespace detail
+
 // Case-insensitive comparison. This is intended to work for both
 // char strings and wchar strings.
 template<typename StringT>
 bool iequals( StringT const& s1, StringT const& s2 ) {
+  if constexpr( std::is_same_v<typename StringT::value_type, char> )
+    return detail::iequals_narrow( s1, s2 );
+
   // This check is for efficiency.
   if( s1.size() != s2.size() ) return false;
 
@@ -114,11 +139,129 @@ std::vector<std::string_view> split_strip( std::string_view sv,
 std::vector<std::string_view> split_strip_any(
     std::string_view sv, std::string_view chars );
 
+namespace detail {
+
+// The string being split and the set of delimiters, held  in  a
+// 256-bit table.
+struct SplitSpec {
+  SplitSpec() = default;
+  SplitSpec( std::string_view sv, std::string_view chars,
+             bool strip );
+
+  // Position of the first delimiter in s, or s.size() if none.
+  size_t find_delim( std::string_view s ) const;
+
+  std::string_view        sv;
+  std::array<uint64_t, 4> table{};
+  // The delimiter if there is exactly one, otherwise -1.
+  int                     single{ -1 };
+  bool                    strip{ false };
+};
+
+} // namespace detail
+
+/****************************************************************
+* SplitView
+*
+* A lazy version of split_on_any (or, if `strip` is true,  of
+* split_strip_any): iterating over it yields the same pieces,  as
+* views into the original string, but one at a time and without
+* allocating. The delimiters are held in a 256-bit table so that
+* checking a character costs the same however many there are, and
+* a single delimiter is searched for with memchr. With `strip`,
+* each piece is stripped and empty ones are  skipped  as  they
+* are found. Iterators carry their own copy of the (small)  state,
+* so they remain valid after the view itself is gone; only the
+* string must outlive them.
+****************************************************************/
+class SplitView : public std::ranges::view_interface<SplitView> {
+
+public:
+  SplitView() = default;
+
+  SplitView( std::string_view sv, std::string_view chars,
+             bool strip )
+    : m_spec( sv, chars, strip ) {}
+
+  class iterator {
+
+  public:
+    using value_type       = std::string_view;
+    using difference_type  = std::ptrdiff_t;
+    using iterator_concept = std::forward_iterator_tag;
+
+    iterator() = default;
+
+    std::string_view operator*() const { return m_piece; }
+
+    iterator& operator++() { advance(); return *this; }
+    iterator  operator++( int ) {
+      auto res = *this;
+      advance();
+      return res;
+    }
+
+    friend bool operator==( iterator const& l, iterator const& r ) {
+      return l.m_done == r.m_done &&
+             ( l.m_done || l.m_piece.data() == r.m_piece.data() );
+    }
+
+    friend bool operator==( iterator const& it,
+                            std::default_sentinel_t ) {
+      return it.m_done;
+    }
+
+  private:
+    friend class SplitView;
+
+    explicit iterator( detail::SplitSpec const& spec )
+      : m_spec( spec ), m_done( false ) {
+      advance();
+    }
+
+    void advance();
+
+    detail::SplitSpec m_spec;
+    std::string_view  m_piece;
+    // Where the piece after m_piece starts, or npos if  m_piece
+    // is the last one.
+    size_t            m_next{ 0 };
+    bool              m_done{ true };
+  };
+
+  iterator begin() const { return iterator( m_spec ); }
+  std::default_sentinel_t end() const { return {}; }
+
+private:
+  detail::SplitSpec m_spec;
+};
+
+// Lazy versions of split and split_on_any.
+SplitView split_view( std::string_view sv, char c );
+SplitView split_view( std::string_view sv, std::string_view chars );
+
+// Lazy versions of split_strip and split_strip_any.
+SplitView split_strip_view( std::string_view sv, char c );
+SplitView split_strip_view( std::string_view sv,
+                            std::string_view chars );
+
 using IsStrOkFunc = std::function<bool( std::string_view )>;
 
 std::optional<std::string> common_prefix(
     std::vector<std::string> const& strings );
 
+// Same as common_prefix but, instead of copying the prefix, returns
+// a view of it in the first string. This only compares the lexico-
+// graphically smallest and largest of the strings, since their com-
+// mon prefix is the common prefix of the whole set. For large inputs
+// the search for those two is split among `jobs` jobs on the default
+// thread pool (zero means all of its threads); small inputs are al-
+// ways done on the calling thread.
+std::optional<std::string_view> common_prefix_view(
+    std::vector<std::string_view> const& strings, int jobs = 1 );
+std::optional<std::string_view> common_prefix_view(
+    std::vector<std::string> const& strings, int jobs = 1 );
+
 // Will wrap the text using the is_ok callback. The callback
 // should return true if the string given to it has an acceptible
 // length. It is assumed that if the function returns false for a
@@ -135,11 +278,32 @@ std::optional<std::string> common_prefix(
 std::vector<std::string> wrap_text_fn(
     std::string_view text, IsStrOkFunc const& is_ok );
 
+// How wrap_text decides where to break lines. GREEDY puts as many
+// words on each line as will fit, in linear time. MIN_RAGGED in-
+// stead chooses the breaks that minimize the sum of the squares of
+// the unused space at the end of each line (not counting the last
+// one), which gives more even lines at the cost of a dynamic  pro-
+// gram that looks back over at most one line's worth of words for
+// each word.
+enum class WrapMode { GREEDY, MIN_RAGGED };
+
 // Wraps text such that each resulting line will be <= to the
 // max_length. The exception is if a word is itself "too long" in
 // which case it will be put on its own line anyway.
-std::vector<std::string> wrap_text( std::string_view text,
-                                    int max_length );
+std::vector<std::string> wrap_text(
+    std::string_view text, int max_length,
+    WrapMode mode = WrapMode::GREEDY );
+
+// Same as wrap_text but, instead of joining the words of each line
+// with single spaces, returns the span of the input that runs from
+// the first to the last word of each line. Line lengths are still
+// computed as if the words were separated by single spaces, so the
+// results are the same as wrap_text's exactly when the words in the
+// input are separated by single spaces (e.g., when the text has
+// already been normalized), and in that case nothing is copied.
+std::vector<std::string_view> wrap_text_views(
+    std::string_view text, int max_length,
+    WrapMode mode = WrapMode::GREEDY );
 
 // Convert element type.
 std::vector<std::string> to_strings(
@@ -160,15 +324,66 @@ std::vector<fs::path> to_paths(
  *they will return a sensibly  formatted result. Unlike
  *std::to_string these overloads work on  various  containers  as
  *well, such as vectors and tuples. For simple  numeric  types
- *util::to_string delegates  to  std::to_string.  If  all else
- *fails, the default overload  attempts  to use a string stream
- *to do the conversion.
+ *util::to_string gives the same results as std::to_string.
  *
  * See the special note below  on  the  std::string  overload. In
  * short, Whenever the to_string methods  convert a string (or
  *any string-like entity) to a string, they will insert quotes in
  *the string itself.
+ *
+ * Each to_string overload is a wrapper around a to_string_into
+ * overload that appends the result to an existing string. This is
+ * how the overloads for containers  format  their  elements,  so
+ * that formatting a nested structure writes straight  into  one
+ * string instead of building and joining a string for every ele-
+ * ment. Callers that format a lot of values can use to_string_into
+ * directly to reuse a buffer.
  ****************************************************************/
+// NOTE: This puts single quotes around the character!
+void to_string_into( std::string& out, char const& c );
+
+void to_string_into( std::string& out, int i );
+void to_string_into( std::string& out, double d );
+
+// NOTE: These put quotes around the string! See to_string below.
+void to_string_into( std::string& out, std::string const& s );
+void to_string_into( std::string& out, std::string_view const& s );
+void to_string_into( std::string& out, char const* s );
+
+// NOTE: This puts quotes around the path! See to_string below.
+void to_string_into( std::string& out, fs::path const& p );
+
+template<typename T>
+void to_string_into( std::string& out, Ref<T> const& rw );
+
+template<typename T>
+void to_string_into( std::string& out, CRef<T> const& rw );
+
+template<typename T>
+void to_string_into( std::string&            out,
+                     std::optional<T> const& opt );
+
+template<typename... Args>
+void to_string_into( std::string&               out,
+                     std::tuple<Args...> const& tp );
+
+template<typename... Args>
+void to_string_into( std::string&                 out,
+                     std::variant<Args...> const& v );
+
+void to_string_into( std::string& out, Error const& e );
+
+template<typename U, typename V>
+void to_string_into( std::string&           out,
+                     std::pair<U, V> const& p );
+
+template<typename T>
+void to_string_into( std::string&          out,
+                     std::vector<T> const& v );
+
+void to_string_into( std::string& out, SysTimePoint const& p );
+void to_string_into( std::string& out, ZonedTimePoint const& p );
+
 // NOTE: This puts single quotes around the character!
 std::string to_string( char const& c );
 
@@ -221,27 +436,6 @@ std::string to_string( std::optional<T> const& opt );
 template<typename... Args>
 std::string to_string( std::tuple<Args...> const& tp );
 
-// This function exists for the purpose of  having  the  compiler
-// deduce the Indexes variadic integer arguments that we can then
-// use to index the tuple; it probably is not useful to call this
-// method  directly  (it is called by to_string). Was not able to
-// find a more elegant way of unpacking an arbitrary tuple passed
-// in as an argument apart from using  this  helper  function in-
-// volving the index_sequence.
-template<typename Tuple, size_t... Indexes>
-StrVec tuple_elems_to_string(
-    Tuple const& tp,
-    std::index_sequence<Indexes...> /*unused*/ );
-
-// This function exists for the purpose of  having  the  compiler
-// deduce the Indexes variadic integer arguments that we can then
-// use  to  index  the variant; it probably is not useful to call
-// this method directly (it is called by to_string).
-template<typename Variant, size_t... Indexes>
-std::string variant_elems_to_string(
-    Variant const& v,
-    std::index_sequence<Indexes...> /*unused*/ );
-
 template<typename... Args>
 std::string to_string( std::variant<Args...> const& v );
 
@@ -281,6 +475,11 @@ std::ostream& operator<<( std::ostream&          out,
 
 } // namespace util
 
+// Iterators don't refer back to the view.
+template<>
+inline constexpr bool
+    std::ranges::enable_borrowed_range<util::SplitView> = true;
+
 // Implementations of template  function  bodies  in  here. We do
 // this  not only for organizational purposes, but in order for a
 // to_string method to be able to call any other to_string method
@@ -2,12 +2,29 @@
 * IO related utilities
 ****************************************************************/
 #include "base-util/io.hpp"
+#include "base-util/algo-par.hpp"
+#include "base-util/glob.hpp"
 #include "base-util/macros.hpp"
 #include "base-util/misc.hpp"
 
+#include <algorithm>
+#include <cerrno>
 #include <cstdio>
+#include <cstring>
+#include <condition_variable>
 #include <fstream>
-#include <regex>
+#include <mutex>
+
+#ifdef _WIN32
+#   include <fcntl.h>
+#   include <io.h>
+#else
+#   include <dirent.h>
+#   include <fcntl.h>
+#   include <sys/mman.h>
+#   include <sys/stat.h>
+#   include <unistd.h>
+#endif
 
 using namespace std;
 
@@ -15,10 +32,238 @@ using gsl::owner;
 
 namespace util {
 
+namespace {
+
+// Reads from the stream until EOF, appending to the buffer. This
+// is used for files whose size is not known up front (or  can't
+// be trusted), such as pipes. Closes the stream.
+void read_stream( owner<FILE*> fp, vector<char>& buf,
+                  fs::path const& p ) {
+    constexpr size_t chunk = 1 << 16;
+    size_t size = buf.size();
+    while( true ) {
+        if( buf.size() < size + chunk )
+            buf.resize( max( size + chunk, buf.size()*2 ) );
+        size_t read = fread( buf.data() + size, 1, chunk, fp );
+        size += read;
+        if( read < chunk )
+            break;
+    }
+    bool failed = ferror( fp ) != 0;
+    // Close the file before checking  for  errors  (which  might
+    // throw an exception).
+    fclose( fp );
+    buf.resize( size );
+    ASSERT( !failed, "failed to read file " << p );
+}
+
+} // anonymous namespace
+
+/****************************************************************
+* MappedFile
+****************************************************************/
+MappedFile::MappedFile( fs::path const& p ) {
+    ASSERT( load( p ), "failed to open file " << p );
+}
+
+optional<MappedFile> MappedFile::open( fs::path const& p ) {
+    MappedFile res;
+    if( !res.load( p ) )
+        return nullopt;
+    return res;
+}
+
+MappedFile::~MappedFile() { reset(); }
+
+MappedFile::MappedFile( MappedFile&& other ) noexcept
+  : m_data( other.m_data ),
+    m_size( other.m_size ),
+    m_mapped( other.m_mapped ),
+    m_buffer( std::move( other.m_buffer ) ) {
+    other.m_data   = nullptr;
+    other.m_size   = 0;
+    other.m_mapped = false;
+}
+
+MappedFile& MappedFile::operator=( MappedFile&& other ) noexcept {
+    if( this != &other ) {
+        reset();
+        m_data         = other.m_data;
+        m_size         = other.m_size;
+        m_mapped       = other.m_mapped;
+        m_buffer       = std::move( other.m_buffer );
+        other.m_data   = nullptr;
+        other.m_size   = 0;
+        other.m_mapped = false;
+    }
+    return *this;
+}
+
+void MappedFile::reset() {
+#ifndef _WIN32
+    if( m_mapped )
+        ::munmap( const_cast<char*>( m_data ), m_size );
+#endif
+    m_data   = nullptr;
+    m_size   = 0;
+    m_mapped = false;
+    m_buffer.clear();
+}
+
+bool MappedFile::load( fs::path const& p ) {
+#ifdef _WIN32
+    owner<FILE*> fp{ fopen( p.string().c_str(), "rb" ) };
+    if( !fp )
+        return false;
+#else
+    int fd = ::open( p.c_str(), O_RDONLY | O_CLOEXEC );
+    if( fd < 0 )
+        return false;
+
+    struct stat st{};
+    if( ::fstat( fd, &st ) != 0 || S_ISDIR( st.st_mode ) ) {
+        ::close( fd );
+        return false;
+    }
+
+    // Only regular files are mapped; some special files  (e.g.  in
+    // /proc) claim to be regular but report a size of zero, and so
+    // we must read those to find out what is in them. An empty file
+    // is also not mapped since a zero-length mapping is an error.
+    if( S_ISREG( st.st_mode ) && st.st_size > 0 ) {
+        size_t size = size_t( st.st_size );
+        void*  addr = ::mmap( nullptr, size, PROT_READ, MAP_PRIVATE,
+                              fd, 0 );
+        if( addr != MAP_FAILED ) {
+            // The mapping holds its own reference to the file.
+            ::close( fd );
+            // Most callers scan the file once from start to finish.
+            ::madvise( addr, size, MADV_SEQUENTIAL );
+            m_data   = static_cast<char const*>( addr );
+            m_size   = size;
+            m_mapped = true;
+            return true;
+        }
+        // Otherwise fall back to reading.
+    }
+
+    owner<FILE*> fp{ ::fdopen( fd, "rb" ) };
+    if( !fp ) {
+        ::close( fd );
+        return false;
+    }
+#endif
+    read_stream( fp, m_buffer, p );
+    m_size = m_buffer.size();
+    return true;
+}
+
+/****************************************************************
+* LineReader
+****************************************************************/
+LineReader::LineReader( fs::path const& p, size_t block_size )
+  : m_buf( max<size_t>( block_size, 1 ) ) {
+#ifdef _WIN32
+    m_fd = ::_wopen( p.c_str(), _O_RDONLY | _O_BINARY );
+#else
+    m_fd = ::open( p.c_str(), O_RDONLY | O_CLOEXEC );
+#endif
+    ASSERT( m_fd >= 0, "failed to open file " << p );
+    m_owns_fd = true;
+}
+
+LineReader::LineReader( int fd, size_t block_size )
+  : m_fd( fd ), m_buf( max<size_t>( block_size, 1 ) ) {
+    ASSERT( m_fd >= 0, "invalid file descriptor " << fd );
+}
+
+LineReader::~LineReader() {
+    if( m_owns_fd ) {
+#ifdef _WIN32
+        ::_close( m_fd );
+#else
+        ::close( m_fd );
+#endif
+    }
+}
+
+bool LineReader::fill() {
+    if( m_eof )
+        return false;
+
+    // Move the partial line to the front of the buffer,  growing
+    // the buffer if the partial line fills it.
+    size_t kept = m_end - m_pos;
+    if( m_pos > 0 && kept > 0 )
+        memmove( m_buf.data(), m_buf.data() + m_pos, kept );
+    m_scan -= m_pos;
+    m_pos   = 0;
+    m_end   = kept;
+    if( m_end == m_buf.size() )
+        m_buf.resize( m_buf.size()*2 );
+
+    while( true ) {
+#ifdef _WIN32
+        auto n = ::_read( m_fd, m_buf.data() + m_end,
+                          unsigned( m_buf.size() - m_end ) );
+#else
+        auto n = ::read( m_fd, m_buf.data() + m_end,
+                         m_buf.size() - m_end );
+#endif
+        if( n < 0 && errno == EINTR )
+            continue;
+        ASSERT( n >= 0, "failed to read file: " << strerror( errno ) );
+        if( n == 0 ) {
+            m_eof = true;
+            return false;
+        }
+        m_end += size_t( n );
+        return true;
+    }
+}
+
+optional<string_view> LineReader::next() {
+    constexpr char LF = 0x0A;
+    constexpr char CR = 0x0D;
+
+    while( true ) {
+        char const* base = m_buf.data();
+        // memchr is vectorized by the C library.
+        auto const* nl = static_cast<char const*>(
+            memchr( base + m_scan, LF, m_end - m_scan ) );
+        if( nl ) {
+            string_view line( base + m_pos, size_t( nl - base ) - m_pos );
+            m_pos = m_scan = size_t( nl - base ) + 1;
+            if( !line.empty() && line.back() == CR )
+                line.remove_suffix( 1 );
+            return line;
+        }
+        m_scan = m_end;
+        if( !fill() ) {
+            // Final line with no newline.
+            if( m_pos == m_end )
+                return nullopt;
+            string_view line( m_buf.data() + m_pos, m_end - m_pos );
+            m_pos = m_scan = m_end;
+            return line;
+        }
+    }
+}
+
+void LineReader::iterator::advance() {
+    if( auto line = m_reader->next() )
+        m_line = *line;
+    else
+        m_reader = nullptr;
+}
+
+/****************************************************************
+* Whole-file Reading and Writing
+****************************************************************/
 // Read  a  file in its entirety into a vector of chars. This may
 // be a bit less efficient than possible because the vector, when
 // created, will initialize all of its bytes  to  zero  which  we
-// don't actually need.
+// don't actually need. Use MappedFile if a copy is not needed.
 vector<char> read_file( fs::path const& p ) {
 
     ASSERT( fs::exists( p ), "file " << p << " does not exist" );
@@ -45,13 +290,21 @@ vector<char> read_file( fs::path const& p ) {
 
 // Open the file, truncate it,  and  write  given  vector  to  it.
 void write_file( fs::path const& p, vector<char> const& v ) {
+    write_file( p, span<char const>( v ) );
+}
+
+// Same as above but for any contiguous range of bytes.
+void write_file( fs::path const& p, span<char const> v ) {
 
     gsl::owner<FILE*> fp{ fopen( p.string().c_str(), "wb" ) };
     ASSERT( fp, "failed to open or create file " << p );
 
     size_t size = v.size();
 
-    size_t written = fwrite( (void*)&v[0], 1, size, fp );
+    // An empty span may have a null data pointer, which fwrite
+    // does not accept even when writing nothing.
+    size_t written =
+        size ? fwrite( (void const*)v.data(), 1, size, fp ) : 0;
     // Close the file before checking  for  errors  (which  might
     // throw an exception).
     fclose( fp );
@@ -70,13 +323,19 @@ void write_file( fs::path const& p, vector<char> const& v ) {
 // dows line endings, which is  not  desired.  Hence we have this
 // function which will copy the file in  binary  mode  faithfully.
 void copy_file( fs::path const& from, fs::path const& to ) {
-    // RVO  +  move semantics should ensure that the file data is
-    // not unnecessarily copied.
-    write_file( to, read_file( from ) );
+    // Opening the destination truncates it, which would pull  the
+    // rug out from under the mapping of the source if they  were
+    // the same file.
+    if( fs::exists( to ) && fs::equivalent( from, to ) )
+        return;
+    write_file( to, MappedFile( from ).span() );
 }
 
-// Read a text file into a string in its entirety.
+// Read a text file into a string in its entirety. A single final
+// newline, if present, is not included.
 optional<string> read_file_as_string( fs::path const& p ) {
+#ifdef _WIN32
+    // Read in text mode so that CRLF is collapsed.
 
     ifstream in( p.string() );
     if( !in.good() ) return nullopt;
@@ -107,12 +366,26 @@ optional<string> read_file_as_string( fs::path const& p ) {
             " == " << res->size() << ", size == " << size );
 
     return res; // hoping for NRVO here
+#else
+    auto f = MappedFile::open( p );
+    if( !f ) return nullopt;
+    return read_file_as_string( *f );
+#endif
+}
+
+// Same as above but from a file that is already open.
+string read_file_as_string( MappedFile const& f ) {
+    auto sv = f.view();
+    if( !sv.empty() && sv.back() == '\n' )
+        sv.remove_suffix( 1 );
+    return string( sv );
 }
 
 // Read  a text file into a string in its entirety and then split
 // it into lines.
 StrVec read_file_lines( fs::path const& p ) {
-
+#ifdef _WIN32
+    // Read in text mode so that CRLF is collapsed.
     ifstream in( p.string() );
     ASSERT( in.good(), "failed to open file " << p );
 
@@ -122,13 +395,33 @@ StrVec read_file_lines( fs::path const& p ) {
         res.push_back( line );
 
     return res; // hoping for NRVO here
+#else
+    return read_file_lines( MappedFile( p ) );
+#endif
+}
+
+// Same as above but from a file that is already open.  As  with
+// getline, a final newline does not start a new (empty) line.
+StrVec read_file_lines( MappedFile const& f ) {
+    StrVec res;
+    auto   sv = f.view();
+    while( !sv.empty() ) {
+        auto nl = sv.find( '\n' );
+        if( nl == string_view::npos ) {
+            res.emplace_back( sv );
+            break;
+        }
+        res.emplace_back( sv.substr( 0, nl ) );
+        sv.remove_prefix( nl+1 );
+    }
+    return res; // hoping for NRVO here
 }
 
 // Take a path whose last  component  (file name) contains a glob
 // expression and  return  results  by  searching  the  directory
 // listing for all files (and folders if flag is true) that match
-// the glob pattern. Only *  and  ?  are supported, and those spe-
-// cial  characters  can only appear in the file name of the path.
+// the glob pattern (see util::Glob for the syntax), whose special
+// characters can only appear in the file name of the path.
 // The filename (with wildcard characters)  must match the entire
 // file name from start to finish. If one of the folders  in  the
 // path  does  not  exist, an exception is thrown. If the path is
@@ -151,55 +444,350 @@ PathVec wildcard( fs::path const& p, bool with_folders ) {
 
     PathVec res;
 
-    auto abs    = util::lexically_absolute( p );
+    // Same as lexically_absolute, but we need the CWD again below.
+    auto cwd    = fs::current_path();
+    auto abs    = util::lexically_normal( util::slash( cwd, p ) );
     auto folder = abs.parent_path();
 
-    // ECMAScript is the default if no flags are specified.
-    auto flags = regex::ECMAScript;
-#if CASE_INSENSITIVE_FS()
-    // Filesystem is case-insensitive.
-    flags |= std::regex::icase;
+    // Compiled once and then matched against each entry.
+    Glob glob( abs.filename().string() );
+
+    // For relative output, rather than computing  the  relative  path
+    // of each entry (which renormalizes both paths and rebuilds the
+    // result component by component) we compute the relative path
+    // of the folder once and append  the  entry  names  to  it.  The
+    // exception is when the folder contains the CWD (or  is  one  of
+    // its ancestors), because then the entry that lies on the way to
+    // the CWD has a relative path that collapses (e.g. to "." or to
+    // ".."), so for that one entry we do it the slow way.
+    string             prefix;
+    optional<fs::path> toward_cwd;
+    if( rel ) {
+        auto rel_folder = util::lexically_relative( folder, cwd );
+        if( rel_folder != "." ) {
+            prefix = rel_folder.string();
+            prefix += char( fs::path::preferred_separator );
+        }
+        auto [f, c] = mismatch( folder.begin(), folder.end(),
+                                cwd.begin(),    cwd.end() );
+        if( f == folder.end() && c != cwd.end() )
+            toward_cwd = *c;
+    }
+
+    for( auto& i : fs::directory_iterator( folder ) ) {
+        // The directory entry caches the file type where the  OS
+        // provides it  while  listing,  which  saves  a  stat.
+        if( !with_folders && i.is_directory() )
+            // Don't include folders if  caller doesn't want them.
+            continue;
+        auto const& path = i.path();
+#ifdef _WIN32
+        auto name = path.filename().string();
+#else
+        // Avoids constructing a path for the file name.
+        string_view name = path.native();
+        name.remove_prefix( name.rfind( '/' ) + 1 );
 #endif
+        // The glob must match the full filename.
+        if( !glob.matches( name ) )
+            continue;
+        // Match,  add  it to the list. But we need to be sure to
+        // preserve  absolute/relative   nature.
+        if( !rel )
+            res.push_back( path );
+        else if( toward_cwd && path.filename() == *toward_cwd )
+            res.push_back( util::lexically_relative( path, cwd ) );
+        else {
+            auto prefix_size = prefix.size();
+            prefix.append( name );
+            res.emplace_back( prefix );
+            prefix.resize( prefix_size );
+        }
+    }
+    return res;
+}
+
+namespace {
 
-    // Convert  the  glob  pattern to a regex so we can use regex
-    // machinery  to  match  files. Note that here we are not sup-
-    // porting the full set  of  shell-style  glob symbols. As an
-    // example, the glob "*.?pp" will  be  transformed  into  the
-    // regex: ".*\..pp"
-    string rx_glob;
-    for( auto c : abs.filename().string() ) {
-        switch( c ) {
-            case ']': rx_glob += "\\]"; break;
-            case '[': rx_glob += "\\["; break;
-            case '+': rx_glob += "\\+"; break;
-            case '.': rx_glob += "\\."; break;
-            case '*': rx_glob += ".*";  break;
-            case '?': rx_glob += '.';   break;
-            default : rx_glob += c;     break;
-        };
+/****************************************************************
+* Recursive wildcard
+****************************************************************/
+// One component of the part of a  recursive  wildcard  pattern
+// that follows the base directory: either ** or a glob that must
+// match a single file name.
+struct PatternComponent {
+    bool           globstar;
+    optional<Glob> glob;
+};
+
+// The set of positions in the list of components  that  the  part
+// of the path consumed so far can have  matched  up  to;  bit  j
+// means that the first j components have been matched.
+using PatternStates = uint64_t;
+
+class RecursivePattern {
+
+public:
+    explicit RecursivePattern( vector<PatternComponent> comps )
+      : m_comps( std::move( comps ) ) {
+        ASSERT( m_comps.size() < 64, "too many components in "
+                "recursive wildcard pattern." );
     }
 
-    auto cwd = fs::current_path();
+    PatternStates initial() const { return closure( 1 ); }
+
+    // The states after consuming one more path component.
+    PatternStates step( PatternStates s, string_view name ) const {
+        PatternStates next = 0;
+        for( size_t j = 0; j < m_comps.size(); ++j ) {
+            if( !( ( s >> j ) & 1 ) )
+                continue;
+            auto const& c = m_comps[j];
+            if( c.globstar )
+                next |= PatternStates( 1 ) << j;
+            else if( c.glob->matches( name ) )
+                next |= PatternStates( 1 ) << (j+1);
+        }
+        return closure( next );
+    }
 
-    smatch m;
+    bool accepts( PatternStates s ) const {
+        return ( s >> m_comps.size() ) & 1;
+    }
 
-    for( auto& i : fs::directory_iterator( folder ) ) {
-        if( fs::is_directory( i ) && !with_folders )
-            // Don't include folders if  caller doesn't want them.
+    // Whether any further path components could lead to a match.
+    bool viable( PatternStates s ) const {
+        return ( s & ( ( PatternStates( 1 ) << m_comps.size() ) - 1 ) )
+               != 0;
+    }
+
+private:
+    // ** can also match zero path components.
+    PatternStates closure( PatternStates s ) const {
+        for( size_t j = 0; j < m_comps.size(); ++j )
+            if( m_comps[j].globstar && ( ( s >> j ) & 1 ) )
+                s |= PatternStates( 1 ) << (j+1);
+        return s;
+    }
+
+    vector<PatternComponent> m_comps;
+};
+
+struct DirEntry {
+    string name;
+    // A directory and not a symlink; these are the entries that we
+    // descend into.
+    bool   is_dir;
+    // A directory or a symlink to one; these are the entries  that
+    // are left out when folders are not wanted, as in wildcard.
+    bool   is_dir_target;
+};
+
+// Lists the entries of a directory (other than . and ..).  On POSIX
+// this uses the file type returned by readdir where the file sys-
+// tem provides it, so that a stat call is only needed for symlinks
+// (to see whether they point to directories). Returns false if the
+// directory could not be opened.
+bool list_dir( fs::path const& dir, vector<DirEntry>& out ) {
+    out.clear();
+#ifdef _WIN32
+    error_code ec;
+    fs::directory_iterator it( dir.empty() ? "." : dir, ec );
+    if( ec )
+        return false;
+    for( ; it != fs::directory_iterator(); it.increment( ec ) ) {
+        if( ec )
+            break;
+        error_code ec2;
+        bool target_dir = it->is_directory( ec2 );
+        out.push_back( { it->path().filename().string(),
+                         target_dir && !it->is_symlink( ec2 ),
+                         target_dir } );
+    }
+    return true;
+#else
+    DIR* d = ::opendir( dir.empty() ? "." : dir.c_str() );
+    if( !d )
+        return false;
+    auto stat_is_dir = [&]( char const* name, int flags ) {
+        struct stat st;
+        return ::fstatat( ::dirfd( d ), name, &st, flags ) == 0 &&
+               S_ISDIR( st.st_mode );
+    };
+    while( auto* e = ::readdir( d ) ) {
+        string_view name = e->d_name;
+        if( name == "." || name == ".." )
+            continue;
+        bool is_link = false, is_dir = false;
+#   ifdef DT_DIR
+        if( e->d_type != DT_UNKNOWN ) {
+            is_dir  = ( e->d_type == DT_DIR );
+            is_link = ( e->d_type == DT_LNK );
+        } else
+#   endif
+        {
+            struct stat st;
+            if( ::fstatat( ::dirfd( d ), e->d_name, &st,
+                           AT_SYMLINK_NOFOLLOW ) == 0 ) {
+                is_dir  = S_ISDIR( st.st_mode );
+                is_link = S_ISLNK( st.st_mode );
+            }
+        }
+        bool is_dir_target =
+            is_dir || ( is_link && stat_is_dir( e->d_name, 0 ) );
+        out.push_back( { string( name ), is_dir, is_dir_target } );
+    }
+    ::closedir( d );
+    return true;
+#endif
+}
+
+bool has_glob_chars( string const& s ) {
+    return s.find_first_of( "*?[" ) != string::npos;
+}
+
+} // anonymous namespace
+
+// Walks the tree below the leading  components  of  p  that  have
+// no glob characters (which must be an existing folder).  Direct-
+// ories that remain to be listed are kept on a shared queue from
+// which `jobs` jobs on the default pool take them; listing a dir-
+// ectory may add its subdirectories to the queue, so the walk  is
+// over when the queue is empty and no job is listing one. Symlinks
+// are never followed (though they can match), and subdirectories
+// that can't be read are skipped. If the callback throws then the
+// walk stops and the exception is rethrown.
+void for_each_wildcard( fs::path const&                          p,
+                        function<void( fs::path const& )> const& on_match,
+                        bool with_folders, int jobs ) {
+    if( p.empty() )
+        return;
+
+    fs::path                 base;
+    vector<PatternComponent> comps;
+    for( auto const& elem : p ) {
+        auto s = elem.string();
+        if( comps.empty() && !has_glob_chars( s ) ) {
+            base /= elem;
             continue;
-        // This must be an lvalue for regex_match.
-        auto fn = i.path().filename().string();
-        // regex_match forces regex to match full filename. Regex
-        // must match full filename.
-        if( regex_match( fn, m, regex( rx_glob, flags ) ) ) {
-            res.emplace_back(
-                // Match,  add  it to the list. But we need to be
-                // sure  to  preserve  absolute/relative   nature.
-                rel ? util::lexically_relative( i.path(), cwd )
-                    : fs::path( i )
-            );
         }
+        if( s.empty() ) // from a trailing slash.
+            continue;
+        if( s == "**" ) {
+            // Consecutive **'s are equivalent to one.
+            if( comps.empty() || !comps.back().globstar )
+                comps.push_back( { true, nullopt } );
+        } else {
+            comps.push_back( { false, Glob( s ) } );
+        }
+    }
+
+    if( comps.empty() ) {
+        // Nothing to match, just check that the path exists.
+        if( fs::exists( p ) && ( with_folders || !fs::is_directory( p ) ) )
+            on_match( p );
+        return;
     }
+
+    ASSERT( fs::is_directory( base.empty() ? "." : base ),
+            "folder " << base << " does not exist" );
+
+    RecursivePattern pattern( std::move( comps ) );
+
+    auto& pool = par::default_pool();
+    if( jobs == 0 )
+        jobs = pool.size();
+    ASSERT_( jobs > 0 );
+
+    // Directories that remain to be  listed,  along  with  the  set
+    // of pattern states reached  at  each.  Used  as  a  stack  so
+    // that the walk is roughly depth first, which keeps  the  queue
+    // small on wide trees.
+    vector<pair<fs::path, PatternStates>> queue;
+    queue.emplace_back( base, pattern.initial() );
+    mutex              mtx;
+    condition_variable cv;
+    // Number of jobs currently listing a directory (and that might
+    // therefore add more to the queue).
+    int  active = 0;
+    bool stop   = false;
+
+    mutex callback_mtx;
+
+    auto job = [&] {
+        vector<DirEntry>                      entries;
+        vector<pair<fs::path, PatternStates>> subdirs;
+        PathVec                               matches;
+        while( true ) {
+            pair<fs::path, PatternStates> item;
+            {
+                unique_lock<mutex> lock( mtx );
+                cv.wait( lock, [&]{
+                    return stop || !queue.empty() || active == 0;
+                } );
+                if( stop || queue.empty() ) {
+                    // Either way there is nothing more  for  anyone
+                    // to do.
+                    cv.notify_all();
+                    return;
+                }
+                item = std::move( queue.back() );
+                queue.pop_back();
+                ++active;
+            }
+            try {
+                auto const& [dir, states] = item;
+                subdirs.clear();
+                matches.clear();
+                if( list_dir( dir, entries ) ) {
+                    for( auto const& e : entries ) {
+                        auto next = pattern.step( states, e.name );
+                        if( next == 0 )
+                            continue;
+                        fs::path child = dir.empty() ? fs::path( e.name )
+                                                     : dir / e.name;
+                        if( pattern.accepts( next ) &&
+                            ( with_folders || !e.is_dir_target ) )
+                            matches.push_back( child );
+                        if( e.is_dir && pattern.viable( next ) )
+                            subdirs.emplace_back( std::move( child ),
+                                                  next );
+                    }
+                }
+                lock_guard<mutex> lock( callback_mtx );
+                for( auto const& m : matches )
+                    on_match( m );
+            } catch( ... ) {
+                {
+                    lock_guard<mutex> lock( mtx );
+                    stop = true;
+                    --active;
+                }
+                cv.notify_all();
+                throw;
+            }
+            {
+                lock_guard<mutex> lock( mtx );
+                for( auto& sd : subdirs )
+                    queue.push_back( std::move( sd ) );
+                --active;
+            }
+            cv.notify_all();
+        }
+    };
+
+    vector<function<void()>> funcs( jobs, job );
+    par::in_parallel( pool, funcs );
+}
+
+// Collects the results of the walk above, sorted.
+PathVec wildcard_recursive( fs::path const& p, bool with_folders,
+                            int jobs ) {
+    PathVec res;
+    for_each_wildcard( p,
+        [&]( fs::path const& m ){ res.push_back( m ); },
+        with_folders, jobs );
+    sort( res.begin(), res.end() );
     return res;
 }
 
@@ -2,47 +2,450 @@
 * Utilities for handling line endings
 ****************************************************************/
 #include "base-util/line-endings.hpp"
+#include "base-util/algo-par.hpp"
+#include "base-util/glob.hpp"
 #include "base-util/io.hpp"
 
+#include "base-util/macros.hpp"
+
+#include "simd.hpp"
+
+#include <array>
+#include <bit>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <system_error>
+#include <utility>
+
+#ifdef _WIN32
+#   include <io.h>
+#else
+#   include <unistd.h>
+#endif
+
 using namespace std;
 
 namespace util {
 
 namespace {
 
-// Functions that change line endings just take a vector  and  mu-
-// tate it, which is fine for most use cases.
-using Changer = void( vector<char>& );
-
-// Will read in the contents of  the  file (which must exist) and
-// apply the function to it to change line endings, then write it
-// back out. The keepdate flag  indicates  whether the time stamp
-// on the file should remain  unchanged.  By  default,  the  time
-// stamp  will  be  touched  if  any changes to the file are made.
-// Bool return value indicates whether file contents were changed
-// or not (regardless of time stamp).
-bool change_le( Changer* f, fs::path const& p, bool keepdate ) {
-
-    auto v    = read_file( p );
-    auto size = v.size();
-
-    // This function should mutate the vector.
-    f( v );
-
-    // We can use the size of the  new vector relative to the old
-    // size to determine whether  it  was  changed (i.e., whether
-    // any line endings were changed); i.e., a line ending change
-    // will leave the size unchanged if and only if there were no
-    // line endings that needed to be  changed, in which case the
-    // contents of  the  buffer  in  general  will  be  unchanged.
-    if( v.size() == size )
+constexpr char LF = 0x0A;
+constexpr char CR = 0x0D;
+
+/****************************************************************
+* Kernels
+*
+* The vector kernels compare a block of chars against CR and LF
+* at once, producing one bit per char. Blocks without any of the
+* chars of interest (the common case) are copied  with  a  single
+* store; other blocks are copied in segments between the flagged
+* chars using the helpers below, which are shared by all widths.
+****************************************************************/
+// Copies the `width` chars at `in` to `out` skipping those whose
+// bit is set in `cr`. Returns the new end of the output. May  be
+// used in place since the output never gets ahead of the input.
+// This is branchless since lines are short enough that most blocks
+// contain a flagged char somewhere.
+char* remove_flagged( char const* in, unsigned width, uint64_t cr,
+                      char* out ) {
+    for( unsigned k = 0; k < width; ++k ) {
+        *out = in[k];
+        out += 1 - ((cr >> k) & 1);
+    }
+    return out;
+}
+
+// Copies the `width` chars at `in` to `out` inserting a CR before
+// each char whose bit is set in `lf_no_cr`.  Returns  the  new
+// end of the output.
+char* insert_cr( char const* in, unsigned width, uint64_t lf_no_cr,
+                 char* out ) {
+    for( unsigned k = 0; k < width; ++k ) {
+        *out = CR;
+        out += (lf_no_cr >> k) & 1;
+        *out++ = in[k];
+    }
+    return out;
+}
+
+char* dos2unix_scalar( char const* in, size_t n, char* out ) {
+    for( size_t i = 0; i < n; ++i )
+        if( in[i] != CR )
+            *out++ = in[i];
+    return out;
+}
+
+size_t unix2dos_extra_scalar( char const* in, size_t n, char prev ) {
+    size_t extra = 0;
+    for( size_t i = 0; i < n; ++i ) {
+        if( in[i] == LF && prev != CR )
+            ++extra;
+        prev = in[i];
+    }
+    return extra;
+}
+
+char* unix2dos_scalar( char const* in, size_t n, char* out,
+                       char prev ) {
+    for( size_t i = 0; i < n; ++i ) {
+        if( in[i] == LF && prev != CR )
+            *out++ = CR;
+        prev = *out++ = in[i];
+    }
+    return out;
+}
+
+#if UTIL_SIMD_X86
+// SSE2 is part of the x86-64 baseline so needs no dispatch.
+uint64_t eq_mask_sse2( __m128i v, char c ) {
+    return uint32_t( _mm_movemask_epi8(
+        _mm_cmpeq_epi8( v, _mm_set1_epi8( c ) ) ) );
+}
+
+char* dos2unix_sse2( char const* in, size_t n, char* out ) {
+    size_t i = 0;
+    for( ; i + 16 <= n; i += 16 ) {
+        auto v  = _mm_loadu_si128( (__m128i const*)( in+i ) );
+        auto cr = eq_mask_sse2( v, CR );
+        if( cr == 0 ) {
+            _mm_storeu_si128( (__m128i*)out, v );
+            out += 16;
+        } else {
+            out = remove_flagged( in+i, 16, cr, out );
+        }
+    }
+    return dos2unix_scalar( in+i, n-i, out );
+}
+
+size_t unix2dos_extra_sse2( char const* in, size_t n, char prev ) {
+    size_t   extra = 0;
+    size_t   i     = 0;
+    uint64_t carry = ( prev == CR );
+    for( ; i + 16 <= n; i += 16 ) {
+        auto v  = _mm_loadu_si128( (__m128i const*)( in+i ) );
+        auto lf = eq_mask_sse2( v, LF );
+        auto cr = eq_mask_sse2( v, CR );
+        extra += size_t( popcount( lf & ~( (cr << 1) | carry ) ) );
+        carry  = cr >> 15;
+    }
+    if( i > 0 ) prev = in[i-1];
+    return extra + unix2dos_extra_scalar( in+i, n-i, prev );
+}
+
+char* unix2dos_sse2( char const* in, size_t n, char* out,
+                     char prev ) {
+    size_t   i     = 0;
+    uint64_t carry = ( prev == CR );
+    for( ; i + 16 <= n; i += 16 ) {
+        auto v      = _mm_loadu_si128( (__m128i const*)( in+i ) );
+        auto lf     = eq_mask_sse2( v, LF );
+        auto cr     = eq_mask_sse2( v, CR );
+        auto insert = lf & ~( (cr << 1) | carry );
+        carry = cr >> 15;
+        if( insert == 0 ) {
+            _mm_storeu_si128( (__m128i*)out, v );
+            out += 16;
+        } else {
+            out = insert_cr( in+i, 16, insert, out );
+        }
+    }
+    if( i > 0 ) prev = in[i-1];
+    return unix2dos_scalar( in+i, n-i, out, prev );
+}
+#endif
+
+#if UTIL_SIMD_AVX2
+// Shuffle patterns that, given a bit mask of flagged chars in  a
+// group of eight, either squeeze out the flagged chars (compress)
+// or insert a CR before each of them (expand, with byte 8 of the
+// input holding a CR). Unused lanes are zeroed (0x80).
+constexpr auto compress_lut = [] {
+    array<array<uint8_t, 8>, 256> res{};
+    for( unsigned m = 0; m < 256; ++m ) {
+        unsigned j = 0;
+        for( unsigned k = 0; k < 8; ++k )
+            if( !( (m >> k) & 1 ) ) res[m][j++] = uint8_t( k );
+        while( j < 8 ) res[m][j++] = 0x80;
+    }
+    return res;
+}();
+
+constexpr auto expand_lut = [] {
+    array<array<uint8_t, 16>, 256> res{};
+    for( unsigned m = 0; m < 256; ++m ) {
+        unsigned j = 0;
+        for( unsigned k = 0; k < 8; ++k ) {
+            if( (m >> k) & 1 ) res[m][j++] = 8;
+            res[m][j++] = uint8_t( k );
+        }
+        while( j < 16 ) res[m][j++] = 0x80;
+    }
+    return res;
+}();
+
+// Same as remove_flagged but for a block of 32, eight at a time.
+// Each group is loaded before anything is stored over it, and the
+// output never gets ahead of the input, so this works in place.
+UTIL_TARGET_AVX2
+char* remove_flagged_avx2( char const* in, uint64_t cr, char* out ) {
+    for( unsigned g = 0; g < 4; ++g ) {
+        auto m = unsigned( (cr >> (8*g)) & 0xff );
+        auto x = _mm_loadl_epi64( (__m128i const*)( in + 8*g ) );
+        if( m != 0 )
+            x = _mm_shuffle_epi8( x, _mm_loadl_epi64(
+                    (__m128i const*)compress_lut[m].data() ) );
+        _mm_storel_epi64( (__m128i*)out, x );
+        out += 8 - popcount( m );
+    }
+    return out;
+}
+
+// Same as insert_cr but for a block of 32, eight at a time. This
+// always stores 16 bytes per group, and so the caller must ensure
+// that there is room for that beyond the end of this block's out-
+// put (it suffices for at least 16 more input chars to follow).
+UTIL_TARGET_AVX2
+char* insert_cr_avx2( char const* in, uint64_t lf_no_cr, char* out ) {
+    auto const crs = _mm_set1_epi8( CR );
+    for( unsigned g = 0; g < 4; ++g ) {
+        auto m = unsigned( (lf_no_cr >> (8*g)) & 0xff );
+        auto x = _mm_unpacklo_epi64(
+            _mm_loadl_epi64( (__m128i const*)( in + 8*g ) ), crs );
+        x = _mm_shuffle_epi8( x, _mm_loadu_si128(
+                (__m128i const*)expand_lut[m].data() ) );
+        _mm_storeu_si128( (__m128i*)out, x );
+        out += 8 + popcount( m );
+    }
+    return out;
+}
+
+UTIL_TARGET_AVX2
+uint64_t eq_mask_avx2( __m256i v, char c ) {
+    return uint32_t( _mm256_movemask_epi8(
+        _mm256_cmpeq_epi8( v, _mm256_set1_epi8( c ) ) ) );
+}
+
+UTIL_TARGET_AVX2
+char* dos2unix_avx2( char const* in, size_t n, char* out ) {
+    size_t i = 0;
+    for( ; i + 32 <= n; i += 32 ) {
+        auto v  = _mm256_loadu_si256( (__m256i const*)( in+i ) );
+        auto cr = eq_mask_avx2( v, CR );
+        if( cr == 0 ) {
+            _mm256_storeu_si256( (__m256i*)out, v );
+            out += 32;
+        } else {
+            out = remove_flagged_avx2( in+i, cr, out );
+        }
+    }
+    return dos2unix_sse2( in+i, n-i, out );
+}
+
+UTIL_TARGET_AVX2
+size_t unix2dos_extra_avx2( char const* in, size_t n, char prev ) {
+    size_t   extra = 0;
+    size_t   i     = 0;
+    uint64_t carry = ( prev == CR );
+    for( ; i + 32 <= n; i += 32 ) {
+        auto v  = _mm256_loadu_si256( (__m256i const*)( in+i ) );
+        auto lf = eq_mask_avx2( v, LF );
+        auto cr = eq_mask_avx2( v, CR );
+        extra += size_t( popcount( lf & ~( (cr << 1) | carry ) ) );
+        carry  = cr >> 31;
+    }
+    if( i > 0 ) prev = in[i-1];
+    return extra + unix2dos_extra_sse2( in+i, n-i, prev );
+}
+
+UTIL_TARGET_AVX2
+char* unix2dos_avx2( char const* in, size_t n, char* out,
+                     char prev ) {
+    size_t   i     = 0;
+    uint64_t carry = ( prev == CR );
+    for( ; i + 32 <= n; i += 32 ) {
+        auto v      = _mm256_loadu_si256( (__m256i const*)( in+i ) );
+        auto lf     = eq_mask_avx2( v, LF );
+        auto cr     = eq_mask_avx2( v, CR );
+        auto insert = lf & ~( (cr << 1) | carry );
+        carry = cr >> 31;
+        if( insert == 0 ) {
+            _mm256_storeu_si256( (__m256i*)out, v );
+            out += 32;
+        } else if( i + 48 <= n ) {
+            out = insert_cr_avx2( in+i, insert, out );
+        } else {
+            out = insert_cr( in+i, 32, insert, out );
+        }
+    }
+    if( i > 0 ) prev = in[i-1];
+    return unix2dos_sse2( in+i, n-i, out, prev );
+}
+#endif
+
+/****************************************************************
+* Converting Files
+****************************************************************/
+// Files are converted in blocks of this size so that the  memory
+// used does not depend on the size of the file.
+constexpr size_t block_size = 1 << 20;
+
+// A line ending conversion as applied to one block of  a  file.
+// `prev` is the last char of the previous block (zero for the
+// first block), which unix2dos needs in order to recognize a CRLF
+// pair that is split across blocks.
+struct Conversion {
+    // Whether converting the block would change it.
+    bool   (*changes)( span<char const> in, char prev );
+    // Writes the converted block to `out`, which has room for
+    // twice the size of the block, and returns its size.
+    size_t (*convert)( span<char const> in, char* out, char prev );
+};
+
+Conversion const dos2unix_conv{
+    []( span<char const> in, char ) {
+        return memchr( in.data(), CR, in.size() ) != nullptr;
+    },
+    []( span<char const> in, char* out, char ) {
+        return dos2unix_span( in, out );
+    }
+};
+
+Conversion const unix2dos_conv{
+    []( span<char const> in, char prev ) {
+        return unix2dos_size( in, prev ) != in.size();
+    },
+    []( span<char const> in, char* out, char prev ) {
+        return unix2dos_span( in, out, prev );
+    }
+};
+
+using FilePtr = unique_ptr<FILE, int(*)( FILE* )>;
+
+// Reads the file from its current position to the end in blocks
+// of buf.size(), calling f( block, prev ) on each. Stops early if
+// f returns false, in which case this returns false.
+template<typename FuncT>
+bool for_blocks( FILE* fp, vector<char>& buf, fs::path const& p,
+                 FuncT f ) {
+    char prev = 0;
+    while( true ) {
+        size_t read = fread( buf.data(), 1, buf.size(), fp );
+        ASSERT( !ferror( fp ), "failed to read file " << p );
+        if( read == 0 )
+            return true;
+        if( !f( span<char const>( buf.data(), read ), prev ) )
+            return false;
+        prev = buf[read-1];
+    }
+}
+
+// Creates a new, empty file in the same folder as `p` (so that it
+// can be renamed over `p`) and opens it for writing.
+pair<fs::path, FilePtr> open_temp( fs::path const& p ) {
+    auto stem = "." + p.filename().string() + ".";
+#ifdef _WIN32
+    random_device rd;
+    for( int attempt = 0; attempt < 100; ++attempt ) {
+        auto tmp = p.parent_path() / ( stem + to_string( rd() ) );
+        if( fs::exists( tmp ) )
+            continue;
+        FilePtr fp( fopen( tmp.string().c_str(), "wb" ), fclose );
+        ASSERT( fp, "failed to create file " << tmp );
+        return { tmp, std::move( fp ) };
+    }
+    ERROR( "failed to create a temporary file next to " << p );
+#else
+    string name = ( p.parent_path() / ( stem + "XXXXXX" ) ).string();
+    int fd = ::mkstemp( name.data() );
+    ASSERT( fd >= 0, "failed to create a temporary file next to "
+                     << p << ": " << strerror( errno ) );
+    FilePtr fp( ::fdopen( fd, "wb" ), fclose );
+    if( !fp ) {
+        ::close( fd );
+        fs::remove( name );
+        ERROR( "failed to open " << name );
+    }
+    return { fs::path( name ), std::move( fp ) };
+#endif
+}
+
+// Flushes the file's data to disk and closes it.
+void sync_and_close( FilePtr fp, fs::path const& p ) {
+    bool ok = fflush( fp.get() ) == 0;
+#ifdef _WIN32
+    ok = ok && ::_commit( ::_fileno( fp.get() ) ) == 0;
+#else
+    ok = ok && ::fsync( ::fileno( fp.get() ) ) == 0;
+#endif
+    ok = fclose( fp.release() ) == 0 && ok;
+    ASSERT( ok, "failed to write file " << p );
+}
+
+// Will apply the conversion to the file (which must exist). The
+// file is streamed through in blocks, first to find out whether
+// anything needs to change, and if so, a second time to write the
+// converted contents to a temporary file in the same folder which
+// then replaces the original by way of a rename. This  way  the
+// memory used is bounded, files that don't need converting are
+// never written, and the original is not left  half-written  if
+// we crash. The permissions of the file are preserved, and if the
+// path is a symlink then its target is replaced. The keepdate flag
+// indicates whether the time stamp on the file should  remain
+// unchanged.  By default, the time stamp will be touched if any
+// changes to the file are made. Bool return value indicates
+// whether file contents were changed or not (regardless of time
+// stamp).
+bool change_le( Conversion const& conv, fs::path const& p_in,
+                bool keepdate ) {
+
+    auto p = fs::is_symlink( p_in ) ? fs::canonical( p_in ) : p_in;
+
+    FilePtr in( fopen( p.string().c_str(), "rb" ), fclose );
+    ASSERT( in, "failed to open file " << p );
+
+    vector<char> buf( block_size );
+
+    bool clean = for_blocks( in.get(), buf, p,
+        [&]( span<char const> block, char prev ) {
+            return !conv.changes( block, prev );
+        } );
+    if( clean )
         return false;
 
+    rewind( in.get() );
+
     // Get the pre-modification time stamp on the file in case we
     // need to restore it (i.e., keepdate == true).
-    auto t0 = util::timestamp( p );
+    auto t0    = util::timestamp( p );
+    auto perms = fs::status( p ).permissions();
 
-    write_file( p, v ); // Will always touch time stamp
+    auto [tmp, out] = open_temp( p );
+    try {
+        vector<char> out_buf( 2*block_size );
+        for_blocks( in.get(), buf, p,
+            [&, &out = out]( span<char const> block, char prev ) {
+                size_t size = conv.convert( block, out_buf.data(),
+                                            prev );
+                ASSERT( fwrite( out_buf.data(), 1, size, out.get() )
+                            == size,
+                        "failed to write file " << tmp );
+                return true;
+            } );
+        sync_and_close( std::move( out ), tmp );
+        fs::permissions( tmp, perms );
+        // Some platforms won't replace a file that is open.
+        in.reset();
+        util::rename( tmp, p );
+    } catch( ... ) {
+        out.reset();
+        error_code ec;
+        fs::remove( tmp, ec );
+        throw;
+    }
 
     if( keepdate )
         // restore time stamp
@@ -51,8 +454,110 @@ bool change_le( Changer* f, fs::path const& p, bool keepdate ) {
     return true; // true means that we changed the file contents.
 }
 
+/****************************************************************
+* Batch Conversion
+****************************************************************/
+using FileConverter = bool( fs::path const&, bool );
+
+vector<Result<bool>> convert_all( FileConverter* f,
+                                  PathVec const& paths,
+                                  bool keepdate, int jobs ) {
+    auto& pool = par::default_pool();
+    if( jobs == 0 )
+        jobs = min( pool.size(), default_io_jobs );
+    // The files will vary widely in size, so let idle jobs steal.
+    return par::map_safe( pool,
+        [&]( fs::path const& p ){ return f( p, keepdate ); },
+        paths, jobs, par::Schedule::STEALING );
+}
+
+PairVec<fs::path, Result<bool>> convert_tree( FileConverter* f,
+                                              fs::path const& root,
+                                              string_view glob,
+                                              bool keepdate, int jobs ) {
+    Glob pattern( glob );
+
+    PathVec paths;
+    for( auto const& e : fs::recursive_directory_iterator( root ) ) {
+        if( e.is_symlink() || !e.is_regular_file() )
+            continue;
+        if( pattern.matches( e.path().filename().string() ) )
+            paths.push_back( e.path() );
+    }
+    sort( paths.begin(), paths.end() );
+
+    auto results = convert_all( f, paths, keepdate, jobs );
+
+    PairVec<fs::path, Result<bool>> res;
+    res.reserve( paths.size() );
+    for( size_t i = 0; i < paths.size(); ++i )
+        res.emplace_back( std::move( paths[i] ),
+                          std::move( results[i] ) );
+    return res;
+}
+
 } // anonymous namespace
 
+size_t dos2unix_span( span<char const> in, char* out ) {
+    char* end;
+#if UTIL_SIMD_AVX2
+    if( simd::has_avx2() )
+        end = dos2unix_avx2( in.data(), in.size(), out );
+    else
+#endif
+#if UTIL_SIMD_X86
+        end = dos2unix_sse2( in.data(), in.size(), out );
+#else
+        end = dos2unix_scalar( in.data(), in.size(), out );
+#endif
+    return size_t( end - out );
+}
+
+size_t unix2dos_size( span<char const> in, char prev ) {
+    size_t extra;
+#if UTIL_SIMD_AVX2
+    if( simd::has_avx2() )
+        extra = unix2dos_extra_avx2( in.data(), in.size(), prev );
+    else
+#endif
+#if UTIL_SIMD_X86
+        extra = unix2dos_extra_sse2( in.data(), in.size(), prev );
+#else
+        extra = unix2dos_extra_scalar( in.data(), in.size(), prev );
+#endif
+    return in.size() + extra;
+}
+
+size_t unix2dos_span( span<char const> in, char* out, char prev ) {
+    char* end;
+#if UTIL_SIMD_AVX2
+    if( simd::has_avx2() )
+        end = unix2dos_avx2( in.data(), in.size(), out, prev );
+    else
+#endif
+#if UTIL_SIMD_X86
+        end = unix2dos_sse2( in.data(), in.size(), out, prev );
+#else
+        end = unix2dos_scalar( in.data(), in.size(), out, prev );
+#endif
+    return size_t( end - out );
+}
+
+// Same as the container versions  above  but  read from a mapped
+// file (which can't be mutated), returning the result in  a  new
+// vector.
+vector<char> dos2unix( MappedFile const& f ) {
+    vector<char> res( f.size() );
+    res.resize( dos2unix_span( f.span(), res.data() ) );
+    return res;
+}
+
+vector<char> unix2dos( MappedFile const& f ) {
+    vector<char> res( unix2dos_size( f.span() ) );
+    unix2dos_span( f.span(), res.data() );
+    return res;
+}
+
 // Open the given path and edit  it to remove all 0x0D characters.
 // This  attempts to emulate the command line utility of the same
 // name.  As  with  the  command,  the  `keepdate` flag indicates
@@ -61,8 +566,7 @@ bool change_le( Changer* f, fs::path const& p, bool keepdate ) {
 // file are made. Bool return value indicates  whether  file  con-
 // tents were changed or not (regardless of time stamp).
 bool dos2unix( fs::path const& p, bool keepdate ) {
-    auto fn = []( vector<char>& _ ) { dos2unix( _ ); };
-    return change_le( fn, p, keepdate );
+    return change_le( dos2unix_conv, p, keepdate );
 }
 
 // Open  the given path and edit it to change LF to CRLF. This at-
@@ -76,8 +580,31 @@ bool dos2unix( fs::path const& p, bool keepdate ) {
 // whether file contents were changed  or not (regardless of time-
 // stamp).
 bool unix2dos( fs::path const& p, bool keepdate ) {
-    auto fn = []( vector<char>& _ ) { unix2dos( _ ); };
-    return change_le( fn, p, keepdate );
+    return change_le( unix2dos_conv, p, keepdate );
+}
+
+vector<Result<bool>> dos2unix( PathVec const& paths, bool keepdate,
+                               int jobs ) {
+    return convert_all( dos2unix, paths, keepdate, jobs );
+}
+
+vector<Result<bool>> unix2dos( PathVec const& paths, bool keepdate,
+                               int jobs ) {
+    return convert_all( unix2dos, paths, keepdate, jobs );
+}
+
+PairVec<fs::path, Result<bool>> dos2unix_tree( fs::path const& root,
+                                               string_view glob,
+                                               bool keepdate,
+                                               int  jobs ) {
+    return convert_tree( dos2unix, root, glob, keepdate, jobs );
+}
+
+PairVec<fs::path, Result<bool>> unix2dos_tree( fs::path const& root,
+                                               string_view glob,
+                                               bool keepdate,
+                                               int  jobs ) {
+    return convert_tree( unix2dos, root, glob, keepdate, jobs );
 }
 
 }
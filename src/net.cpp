@@ -1,44 +1,302 @@
 /****************************************************************
 * Network Utilities
 ****************************************************************/
+#include "base-util/macros.hpp"
 #include "base-util/net.hpp"
 
-#include <cctype>
-#include <iomanip>
-#include <sstream>
+#include "simd.hpp"
+
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <cstring>
 #include <string>
 
 using namespace std;
 
 namespace net {
 
-// URL-encode a string.
-//
-// Implementation is adapted from code found here:
-//
-//   stackoverflow.com/questions/154536/encode-decode-urls-in-c
-string url_encode( string_view in ) {
+namespace {
 
-    ostringstream escaped;
-    escaped.fill( '0' );
-    escaped << hex;
+/****************************************************************
+* Tables
+****************************************************************/
+// Alpha-num and a few other characters are kept intact; all other
+// bytes are percent-encoded. This is done without regard to  the
+// locale.
+constexpr bool is_url_safe( unsigned char c ) {
+    return ( c >= 'a' && c <= 'z' ) || ( c >= 'A' && c <= 'Z' ) ||
+           ( c >= '0' && c <= '9' ) || c == '-' || c == '_' ||
+             c == '.' || c == '~';
+}
 
-    for( auto c : in ) {
+// The encoding of each byte: the first `size` of `chars` are the
+// output. The size is stored alongside the characters so that the
+// encoder can always copy all three and then advance by the size,
+// without branching on whether the byte is safe.
+struct Encoded {
+    char    chars[3];
+    uint8_t size;
+};
 
-        // Keep alpha-num and other  accepted  characters  intact.
-        if( isalnum( c ) != 0 || c == '-' || c == '_' ||
-                                 c == '.' || c == '~' ) {
-            escaped << c;
-            continue;
+constexpr auto encode_table = [] {
+    constexpr char digits[] = "0123456789ABCDEF";
+    array<Encoded, 256> res{};
+    for( int i = 0; i < 256; ++i ) {
+        auto c = (unsigned char)i;
+        if( is_url_safe( c ) )
+            res[i] = { { char( c ), 0, 0 }, 1 };
+        else
+            res[i] = { { '%', digits[c >> 4], digits[c & 0xf] }, 3 };
+    }
+    return res;
+}();
+
+// Value of each hex digit (either case), or -1 for bytes that are
+// not hex digits.
+constexpr auto hex_table = [] {
+    array<int8_t, 256> res{};
+    for( int i = 0; i < 256; ++i ) {
+        if( i >= '0' && i <= '9' )      res[i] = int8_t( i-'0' );
+        else if( i >= 'a' && i <= 'f' ) res[i] = int8_t( i-'a'+10 );
+        else if( i >= 'A' && i <= 'F' ) res[i] = int8_t( i-'A'+10 );
+        else                            res[i] = -1;
+    }
+    return res;
+}();
+
+/****************************************************************
+* SIMD classification
+****************************************************************/
+// These return a mask with bit i set if byte i of the block at p
+// needs to be escaped. Each range [lo,hi] is tested with a single
+// signed comparison by first shifting lo down to -128.
+#if UTIL_SIMD_X86
+__m128i in_range_sse2( __m128i x, char lo, char hi ) {
+    auto t = _mm_add_epi8( x, _mm_set1_epi8( char( 0x80-lo ) ) );
+    return _mm_cmplt_epi8( t, _mm_set1_epi8( char( 0x80+(hi-lo+1) ) ) );
+}
+
+uint32_t unsafe_mask_sse2( char const* p ) {
+    auto x    = _mm_loadu_si128( (__m128i const*)p );
+    auto safe = _mm_or_si128(
+        // OR-ing in 0x20 maps upper case letters onto lower case
+        // ones and nothing else onto a letter.
+        in_range_sse2( _mm_or_si128( x, _mm_set1_epi8( 0x20 ) ),
+                       'a', 'z' ),
+        in_range_sse2( x, '0', '9' ) );
+    safe = _mm_or_si128( safe, in_range_sse2( x, '-', '.' ) );
+    safe = _mm_or_si128( safe,
+        _mm_cmpeq_epi8( x, _mm_set1_epi8( '_' ) ) );
+    safe = _mm_or_si128( safe,
+        _mm_cmpeq_epi8( x, _mm_set1_epi8( '~' ) ) );
+    return uint32_t( _mm_movemask_epi8( safe ) ) ^ 0xffff;
+}
+#endif
+
+#if UTIL_SIMD_AVX2
+UTIL_TARGET_AVX2 __m256i in_range_avx2( __m256i x, char lo, char hi ) {
+    auto t = _mm256_add_epi8( x, _mm256_set1_epi8( char( 0x80-lo ) ) );
+    return _mm256_cmpgt_epi8(
+        _mm256_set1_epi8( char( 0x80+(hi-lo+1) ) ), t );
+}
+
+UTIL_TARGET_AVX2 uint32_t unsafe_mask_avx2( char const* p ) {
+    auto x    = _mm256_loadu_si256( (__m256i const*)p );
+    auto safe = _mm256_or_si256(
+        in_range_avx2( _mm256_or_si256( x, _mm256_set1_epi8( 0x20 ) ),
+                       'a', 'z' ),
+        in_range_avx2( x, '0', '9' ) );
+    safe = _mm256_or_si256( safe, in_range_avx2( x, '-', '.' ) );
+    safe = _mm256_or_si256( safe,
+        _mm256_cmpeq_epi8( x, _mm256_set1_epi8( '_' ) ) );
+    safe = _mm256_or_si256( safe,
+        _mm256_cmpeq_epi8( x, _mm256_set1_epi8( '~' ) ) );
+    return ~uint32_t( _mm256_movemask_epi8( safe ) );
+}
+#endif
+
+/****************************************************************
+* Encoding
+****************************************************************/
+// Encodes n bytes one at a time through the table. Each one writes
+// three bytes to `out`, so there must be two bytes of room  beyond
+// the end of the output.
+char* encode_bytes( char const* in, size_t n, char* out ) {
+    for( size_t i = 0; i < n; ++i ) {
+        auto const& e = encode_table[(unsigned char)in[i]];
+        memcpy( out, e.chars, 3 );
+        out += e.size;
+    }
+    return out;
+}
+
+// Each of these handles as many whole blocks as it can, starting
+// at i, and leaves the rest. Blocks that need no escaping are co-
+// pied straight through.
+#if UTIL_SIMD_X86
+size_t count_unsafe_sse2( char const* in, size_t n, size_t& i ) {
+    size_t res = 0;
+    for( ; i + 16 <= n; i += 16 )
+        res += size_t( popcount( unsafe_mask_sse2( in+i ) ) );
+    return res;
+}
+
+char* encode_sse2( char const* in, size_t n, size_t& i, char* out ) {
+    for( ; i + 16 <= n; i += 16 ) {
+        if( unsafe_mask_sse2( in+i ) == 0 ) {
+            memcpy( out, in+i, 16 );
+            out += 16;
+        } else {
+            out = encode_bytes( in+i, 16, out );
         }
+    }
+    return out;
+}
+#endif
 
-        // Any other characters are percent-encoded.
-        escaped << uppercase;
-        escaped << '%' << setw( 2 ) << int( (unsigned char)c );
-        escaped << nouppercase;
+#if UTIL_SIMD_AVX2
+UTIL_TARGET_AVX2
+size_t count_unsafe_avx2( char const* in, size_t n, size_t& i ) {
+    size_t res = 0;
+    for( ; i + 32 <= n; i += 32 )
+        res += size_t( popcount( unsafe_mask_avx2( in+i ) ) );
+    return res;
+}
+
+UTIL_TARGET_AVX2
+char* encode_avx2( char const* in, size_t n, size_t& i, char* out ) {
+    for( ; i + 32 <= n; i += 32 ) {
+        if( unsafe_mask_avx2( in+i ) == 0 ) {
+            memcpy( out, in+i, 32 );
+            out += 32;
+        } else {
+            out = encode_bytes( in+i, 32, out );
+        }
+    }
+    return out;
+}
+#endif
+
+} // namespace
+
+size_t url_encoded_size( string_view in ) {
+    size_t unsafe = 0, i = 0;
+#if UTIL_SIMD_AVX2
+    if( util::simd::has_avx2() )
+        unsafe += count_unsafe_avx2( in.data(), in.size(), i );
+#endif
+#if UTIL_SIMD_X86
+    unsafe += count_unsafe_sse2( in.data(), in.size(), i );
+#endif
+    for( ; i < in.size(); ++i )
+        unsafe += is_url_safe( (unsigned char)in[i] ) ? 0 : 1;
+    return in.size() + 2*unsafe;
+}
+
+char* detail::url_encode_to( char* dst, string_view in ) {
+    size_t i = 0;
+#if UTIL_SIMD_AVX2
+    if( util::simd::has_avx2() )
+        dst = encode_avx2( in.data(), in.size(), i, dst );
+#endif
+#if UTIL_SIMD_X86
+    dst = encode_sse2( in.data(), in.size(), i, dst );
+#endif
+    return encode_bytes( in.data()+i, in.size()-i, dst );
+}
+
+void url_encode_into( string& out, string_view in ) {
+    size_t old  = out.size();
+    size_t size = url_encoded_size( in );
+    // Two extra bytes for url_encode_to to write past the end.
+    out.resize( old + size + 2 );
+    detail::url_encode_to( out.data() + old, in );
+    out.resize( old + size );
+}
+
+// URL-encode a string.
+string url_encode( string_view in ) {
+    string res;
+    url_encode_into( res, in );
+    return res;
+}
+
+/****************************************************************
+* Decoding
+****************************************************************/
+bool url_decode_into( string& out, string_view in ) {
+    size_t old = out.size();
+    // The result can only be smaller than the input.
+    out.resize( old + in.size() );
+    char*       dst = out.data() + old;
+    char const* p   = in.data();
+    char const* end = p + in.size();
+    while( p != end ) {
+        // Copy everything up to the next escape in one go; memchr
+        // is already vectorized.
+        auto* pct = (char const*)memchr( p, '%', size_t( end-p ) );
+        if( pct == nullptr )
+            pct = end;
+        memcpy( dst, p, size_t( pct-p ) );
+        dst += pct-p;
+        p = pct;
+        if( p == end )
+            break;
+        if( end-p < 3 ) {
+            out.resize( old );
+            return false;
+        }
+        int hi = hex_table[(unsigned char)p[1]];
+        int lo = hex_table[(unsigned char)p[2]];
+        if( ( hi | lo ) < 0 ) {
+            out.resize( old );
+            return false;
+        }
+        *dst++ = char( ( hi << 4 ) | lo );
+        p += 3;
     }
+    out.resize( size_t( dst - out.data() ) );
+    return true;
+}
+
+optional<string> url_decode( string_view in ) {
+    string res;
+    if( !url_decode_into( res, in ) )
+        return nullopt;
+    return res;
+}
 
-    return escaped.str();
+/****************************************************************
+* QueryParser
+****************************************************************/
+QueryParser::QueryParser( string_view query ) : m_rest( query ) {}
+
+string_view QueryParser::decode( string_view in, string& buf ) {
+    if( in.find( '%' ) == string_view::npos )
+        return in;
+    buf.clear();
+    ASSERT( url_decode_into( buf, in ),
+            "malformed escape in query string term: " << in );
+    return buf;
+}
+
+optional<QueryParser::Param> QueryParser::next() {
+    while( !m_rest.empty() ) {
+        auto amp  = m_rest.find( '&' );
+        auto term = m_rest.substr( 0, amp );
+        m_rest.remove_prefix( amp == string_view::npos ? m_rest.size()
+                                                       : amp+1 );
+        if( term.empty() )
+            continue;
+        auto eq = term.find( '=' );
+        string_view key = term.substr( 0, eq );
+        string_view val = ( eq == string_view::npos )
+                        ? string_view{} : term.substr( eq+1 );
+        return Param{ decode( key, m_key_buf ),
+                      decode( val, m_value_buf ) };
+    }
+    return nullopt;
 }
 
 } // net
@@ -0,0 +1,275 @@
+/****************************************************************
+* Interned paths
+****************************************************************/
+#include "base-util/path-table.hpp"
+#include "base-util/macros.hpp"
+
+#include <algorithm>
+#include <limits>
+
+using namespace std;
+
+namespace util {
+
+namespace {
+
+bool is_ascii_upper( char c ) {
+    return c >= 'A' && c <= 'Z';
+}
+
+} // anonymous namespace
+
+PathTable::PathTable() {
+    // The node for "." has no component, so it gets the empty one.
+    auto empty = intern_component( "" );
+    m_nodes.push_back( Node{ /*parent=*/0, empty, /*depth=*/0,
+                             /*ancestors=*/0, dot, /*root=*/false,
+                             /*absolute=*/false, /*interned=*/true } );
+    m_component_used[empty] = true;
+    m_num_paths      = 1;
+    m_num_components = 1;
+}
+
+auto PathTable::node( PathId id ) const -> Node const& {
+    ASSERT( size_t( id ) < m_nodes.size(),
+            "invalid path id " << uint32_t( id ) );
+    return m_nodes[size_t( id )];
+}
+
+uint32_t PathTable::intern_component( string_view s ) {
+    if( auto it = m_component_ids.find( s );
+        it != m_component_ids.end() )
+        return it->second;
+    auto id = uint32_t( m_components.size() );
+    m_components.emplace_back( s );
+    m_component_ids.emplace( m_components.back(), id );
+    m_component_used.push_back( false );
+    return id;
+}
+
+void PathTable::mark_interned( uint32_t id ) {
+    // "." is always interned, so this stops there at the latest.
+    for( ; !m_nodes[id].interned; id = m_nodes[id].parent ) {
+        auto& n = m_nodes[id];
+        n.interned = true;
+        ++m_num_paths;
+        if( !m_component_used[n.component] ) {
+            m_component_used[n.component] = true;
+            ++m_num_components;
+        }
+    }
+}
+
+optional<uint32_t> PathTable::find_component( string_view s ) const {
+    if( auto it = m_component_ids.find( s );
+        it != m_component_ids.end() )
+        return it->second;
+    return nullopt;
+}
+
+PathId PathTable::add_child( PathId parent, uint32_t component,
+                             bool root, bool interned ) {
+    auto key = child_key( parent, component );
+    if( auto it = m_children.find( key ); it != m_children.end() ) {
+        // This may be a folded path that is now being interned.
+        if( interned )
+            mark_interned( it->second );
+        return PathId( it->second );
+    }
+
+    ASSERT( m_nodes.size() < numeric_limits<uint32_t>::max(),
+            "too many paths in PathTable." );
+    auto id = uint32_t( m_nodes.size() );
+    // Copy, since pushing onto m_nodes below may invalidate it.
+    Node p = node( parent );
+
+    Node n;
+    n.parent    = uint32_t( parent );
+    n.component = component;
+    n.depth     = p.depth + 1;
+    n.ancestors = uint32_t( m_ancestors.size() );
+    n.folded    = PathId( id );
+    n.root      = root;
+    n.absolute  = p.absolute ||
+        ( root && fs::path( m_components[component] ).has_root_directory() );
+    n.interned  = false;
+
+    // Reserving first ensures that the  elements  being  copied  are
+    // not moved while we copy them.
+    m_ancestors.reserve( m_ancestors.size() + n.depth );
+    for( uint32_t d = 0; d < p.depth; ++d )
+        m_ancestors.push_back( m_ancestors[p.ancestors + d] );
+    m_ancestors.push_back( id );
+
+    m_nodes.push_back( n );
+    m_children.emplace( key, id );
+    if( interned )
+        mark_interned( id );
+
+    // The folded path is  this  one  unless  this  component  or  an
+    // earlier one has upper case letters in it, in which  case  it
+    // is added as well (and is its own folded path), though it is
+    // not marked as interned.
+    auto const& s = m_components[component];
+    if( p.folded != parent || any_of( s.begin(), s.end(),
+                                      is_ascii_upper ) ) {
+        string lower( s );
+        for( auto& c : lower )
+            if( is_ascii_upper( c ) )
+                c = char( c - 'A' + 'a' );
+        auto folded = add_child( p.folded, intern_component( lower ),
+                                 root, /*interned=*/false );
+        m_nodes[id].folded = folded;
+    }
+    return PathId( id );
+}
+
+PathId PathTable::intern( fs::path const& p ) {
+    PathId id = dot;
+    for( auto const& elem : lexically_normal( p ) ) {
+        auto s = elem.string();
+        if( s == "." )
+            // The normal form of an empty path.
+            continue;
+        id = add_child( id, intern_component( s ),
+                        elem.has_root_path() );
+    }
+    return id;
+}
+
+PathId PathTable::child( PathId parent, string_view component ) {
+    ASSERT( !component.empty() && component != "." &&
+            component != ".." &&
+            component.find_first_of( "/\\" ) == string_view::npos,
+            "invalid path component: " << component );
+    (void)node( parent ); // validate.
+    return add_child( parent, intern_component( component ), false );
+}
+
+optional<PathId> PathTable::find( fs::path const& p ) const {
+    PathId id = dot;
+    for( auto const& elem : lexically_normal( p ) ) {
+        auto s = elem.string();
+        if( s == "." )
+            continue;
+        auto component = find_component( s );
+        if( !component )
+            return nullopt;
+        auto it = m_children.find( child_key( id, *component ) );
+        if( it == m_children.end() )
+            return nullopt;
+        id = PathId( it->second );
+    }
+    // The ancestors of an interned node are interned, so only the
+    // last one needs checking.
+    if( !m_nodes[size_t( id )].interned )
+        return nullopt;
+    return id;
+}
+
+fs::path PathTable::to_path( PathId id ) const {
+    auto const& n = node( id );
+    if( n.depth == 0 )
+        return ".";
+    fs::path res;
+    for( uint32_t d = 0; d < n.depth; ++d )
+        res /= m_components[m_nodes[m_ancestors[n.ancestors + d]].component];
+    return res;
+}
+
+string_view PathTable::filename( PathId id ) const {
+    return m_components[node( id ).component];
+}
+
+PathId PathTable::parent( PathId id ) const {
+    auto const& n = node( id );
+    if( n.root || n.depth == 0 )
+        return id;
+    return PathId( n.parent );
+}
+
+size_t PathTable::depth( PathId id ) const {
+    return node( id ).depth;
+}
+
+bool PathTable::is_absolute( PathId id ) const {
+    return node( id ).absolute;
+}
+
+PathId PathTable::ancestor( PathId id, size_t depth ) const {
+    auto const& n = node( id );
+    ASSERT( depth <= n.depth, "path has no ancestor at depth "
+            << depth );
+    if( depth == 0 )
+        return dot;
+    return PathId( m_ancestors[n.ancestors + depth - 1] );
+}
+
+bool PathTable::starts_with( PathId id, PathId prefix ) const {
+    auto const& n = node( id );
+    auto const& p = node( prefix );
+    if( p.depth == 0 )
+        return !n.absolute;
+    return p.depth <= n.depth &&
+           m_ancestors[n.ancestors + p.depth - 1] == uint32_t( prefix );
+}
+
+bool path_equals( PathTable const& table, PathId a, PathId b,
+                  CaseSensitive sen ) {
+    // Same default as the fs::path version.
+    if( sen == CaseSensitive::DEFAULT )
+#ifdef __linux__
+        sen = CaseSensitive::NO;
+#else
+        sen = CaseSensitive::YES;
+#endif
+    if( sen == CaseSensitive::YES )
+        return a == b;
+    return table.folded( a ) == table.folded( b );
+}
+
+// Follows the same algorithm as the fs::path version, but because
+// interned paths are in normal form (so  that  ..'s  can  only
+// appear at the start of a relative path and there are no .'s)
+// each step is simpler.
+optional<PathId> lexically_relative( PathTable& table, PathId p,
+                                     PathId base ) {
+    bool is_abs = table.is_absolute( p );
+    if( is_abs != table.is_absolute( base ) )
+        return nullopt;
+
+    // The two paths agree on their ancestors  up  to  some  depth
+    // and not after, so we can find the length  of  their  common
+    // prefix by binary search.
+    size_t lo = 0;
+    size_t hi = min( table.depth( p ), table.depth( base ) );
+    while( lo < hi ) {
+        size_t mid = ( lo + hi + 1 ) / 2;
+        if( table.ancestor( p, mid ) == table.ancestor( base, mid ) )
+            lo = mid;
+        else
+            hi = mid - 1;
+    }
+    size_t common = lo;
+
+    if( is_abs && common == 0 )
+        // Different root names.
+        return nullopt;
+    // As in the fs::path version, we can't know what  to  do  with
+    // ..'s in the part of the base that is not  shared  (they  can
+    // only be at the start of it).
+    if( !is_abs && common < table.depth( base ) &&
+        table.filename( table.ancestor( base, common+1 ) ) == ".." )
+        return nullopt;
+
+    PathId res     = PathTable::dot;
+    auto   dot_dot = table.intern_component( ".." );
+    for( size_t d = common; d < table.depth( base ); ++d )
+        res = table.add_child( res, dot_dot, false );
+    for( size_t d = common+1; d <= table.depth( p ); ++d )
+        res = table.add_child(
+            res, table.node( table.ancestor( p, d ) ).component, false );
+    return res;
+}
+
+} // namespace util
@@ -0,0 +1,39 @@
+/****************************************************************
+* SIMD support (private to the library)
+*
+* The library is built for the baseline of the target (which on
+* x86-64 includes SSE2), so wider kernels are compiled per-func-
+* tion with UTIL_TARGET_AVX2 and must only be called after check-
+* ing has_avx2() at runtime.
+****************************************************************/
+#pragma once
+
+#if defined( __x86_64__ ) || defined( _M_X64 )
+#   define UTIL_SIMD_X86 1
+#   include <immintrin.h>
+#else
+#   define UTIL_SIMD_X86 0
+#endif
+
+#if UTIL_SIMD_X86 && ( defined( __GNUC__ ) || defined( __clang__ ) )
+#   define UTIL_SIMD_AVX2 1
+#   define UTIL_TARGET_AVX2 __attribute__(( target( "avx2" ) ))
+#else
+#   define UTIL_SIMD_AVX2 0
+#   define UTIL_TARGET_AVX2
+#endif
+
+namespace util::simd {
+
+// Whether the CPU that we are running on supports AVX2. This  is
+// only computed once.
+inline bool has_avx2() {
+#if UTIL_SIMD_AVX2
+    static bool const res = __builtin_cpu_supports( "avx2" );
+    return res;
+#else
+    return false;
+#endif
+}
+
+} // namespace util::simd
@@ -1,11 +1,20 @@
 /****************************************************************
 * String utilities
 ****************************************************************/
+#include "base-util/algo-par.hpp"
 #include "base-util/datetime.hpp"
 #include "base-util/macros.hpp"
 #include "base-util/string.hpp"
 
+#include "simd.hpp"
+
 #include <algorithm>
+#include <array>
+#include <bit>
+#include <cctype>
+#include <charconv>
+#include <cstdint>
+#include <limits>
 #include <optional>
 
 using namespace std;
@@ -29,6 +38,214 @@ bool ends_with( string_view s, string_view w ) {
                      rbegin( w ), rend( w ) ).second == rend( w );
 }
 
+/****************************************************************
+* Case-insensitive comparison
+****************************************************************/
+namespace {
+
+bool is_ascii( char c ) {
+    return (unsigned char)c < 0x80;
+}
+
+char fold_ascii( char c ) {
+    return ( c >= 'A' && c <= 'Z' ) ? char( c + ('a'-'A') ) : c;
+}
+
+// The comparison that iequals has always done one character at a
+// time, which folds case according to the C locale.
+bool iequals_locale( string_view s1, string_view s2 ) {
+    auto predicate = []( char l, char r ) {
+        int           l_i( l ), r_i( r );
+        constexpr int signed_byte_max{ 127 };
+        if( l_i > signed_byte_max || r_i > signed_byte_max )
+            return ( l_i == r_i );
+        return ( tolower( l_i ) == tolower( r_i ) );
+    };
+    return equal( s1.begin(), s1.end(), s2.begin(), s2.end(),
+                  predicate );
+}
+
+#if UTIL_SIMD_X86
+// Lower-cases the ASCII letters in a vector of bytes. Adding 0x3f
+// maps 'A'..'Z' onto the 26 smallest signed bytes, so that a single
+// signed comparison picks them out.
+__m128i fold_sse2( __m128i x ) {
+    auto t     = _mm_add_epi8( x, _mm_set1_epi8( 0x3f ) );
+    auto upper = _mm_cmplt_epi8( t, _mm_set1_epi8( -128+26 ) );
+    return _mm_or_si128( x, _mm_and_si128( upper,
+                                           _mm_set1_epi8( 0x20 ) ) );
+}
+
+// These advance i over blocks of bytes in which a and b  are  the
+// same after folding, and return true (with i at the position of
+// the difference) if they find a block in which they aren't.
+bool fold_mismatch_sse2( char const* a, char const* b, size_t n,
+                         size_t& i ) {
+    for( ; i + 16 <= n; i += 16 ) {
+        auto x = fold_sse2( _mm_loadu_si128( (__m128i const*)( a+i ) ) );
+        auto y = fold_sse2( _mm_loadu_si128( (__m128i const*)( b+i ) ) );
+        auto ne = uint32_t( _mm_movemask_epi8(
+                      _mm_cmpeq_epi8( x, y ) ) ) ^ 0xffff;
+        if( ne ) {
+            i += countr_zero( ne );
+            return true;
+        }
+    }
+    return false;
+}
+#endif
+
+#if UTIL_SIMD_AVX2
+UTIL_TARGET_AVX2 __m256i fold_avx2( __m256i x ) {
+    auto t     = _mm256_add_epi8( x, _mm256_set1_epi8( 0x3f ) );
+    auto upper = _mm256_cmpgt_epi8( _mm256_set1_epi8( -128+26 ), t );
+    return _mm256_or_si256( x, _mm256_and_si256(
+                                   upper, _mm256_set1_epi8( 0x20 ) ) );
+}
+
+UTIL_TARGET_AVX2
+bool fold_mismatch_avx2( char const* a, char const* b, size_t n,
+                         size_t& i ) {
+    for( ; i + 32 <= n; i += 32 ) {
+        auto x = fold_avx2(
+            _mm256_loadu_si256( (__m256i const*)( a+i ) ) );
+        auto y = fold_avx2(
+            _mm256_loadu_si256( (__m256i const*)( b+i ) ) );
+        auto ne = ~uint32_t( _mm256_movemask_epi8(
+                      _mm256_cmpeq_epi8( x, y ) ) );
+        if( ne ) {
+            i += countr_zero( ne );
+            return true;
+        }
+    }
+    return false;
+}
+#endif
+
+// Position of the first byte at which a and b (both of length  n)
+// differ after folding ASCII case, or n if there is none.
+size_t fold_mismatch( char const* a, char const* b, size_t n ) {
+    size_t i = 0;
+#if UTIL_SIMD_AVX2
+    if( simd::has_avx2() && fold_mismatch_avx2( a, b, n, i ) )
+        return i;
+#endif
+#if UTIL_SIMD_X86
+    if( fold_mismatch_sse2( a, b, n, i ) )
+        return i;
+#endif
+    for( ; i < n; ++i )
+        if( fold_ascii( a[i] ) != fold_ascii( b[i] ) )
+            break;
+    return i;
+}
+
+#if UTIL_SIMD_X86
+// These look for candidate positions at which `what` might start in
+// s by comparing the first and last bytes of `what` (which must be
+// ASCII, and already folded) against blocks of  s  at  once,  and
+// then verify each candidate in full. They advance i over the pos-
+// itions that they have ruled out and return true on a match.
+bool find_folded_sse2( string_view s, string_view what, char first,
+                       char last, size_t& i ) {
+    size_t const n   = what.size();
+    size_t const end = s.size() - n + 1; // candidates are [0, end).
+    auto const   f   = _mm_set1_epi8( first );
+    auto const   l   = _mm_set1_epi8( last );
+    for( ; i + 16 <= end; i += 16 ) {
+        auto bf = fold_sse2(
+            _mm_loadu_si128( (__m128i const*)( s.data()+i ) ) );
+        auto bl = fold_sse2(
+            _mm_loadu_si128( (__m128i const*)( s.data()+i+n-1 ) ) );
+        auto mask = uint32_t( _mm_movemask_epi8( _mm_and_si128(
+            _mm_cmpeq_epi8( bf, f ), _mm_cmpeq_epi8( bl, l ) ) ) );
+        for( ; mask; mask &= mask-1 )
+            if( detail::iequals_narrow(
+                    s.substr( i + countr_zero( mask ), n ), what ) )
+                return true;
+    }
+    return false;
+}
+#endif
+
+#if UTIL_SIMD_AVX2
+UTIL_TARGET_AVX2
+bool find_folded_avx2( string_view s, string_view what, char first,
+                       char last, size_t& i ) {
+    size_t const n   = what.size();
+    size_t const end = s.size() - n + 1;
+    auto const   f   = _mm256_set1_epi8( first );
+    auto const   l   = _mm256_set1_epi8( last );
+    for( ; i + 32 <= end; i += 32 ) {
+        auto bf = fold_avx2( _mm256_loadu_si256(
+            (__m256i const*)( s.data()+i ) ) );
+        auto bl = fold_avx2( _mm256_loadu_si256(
+            (__m256i const*)( s.data()+i+n-1 ) ) );
+        auto mask = uint32_t( _mm256_movemask_epi8( _mm256_and_si256(
+            _mm256_cmpeq_epi8( bf, f ), _mm256_cmpeq_epi8( bl, l ) ) ) );
+        for( ; mask; mask &= mask-1 )
+            if( detail::iequals_narrow(
+                    s.substr( i + countr_zero( mask ), n ), what ) )
+                return true;
+    }
+    return false;
+}
+#endif
+
+} // anonymous namespace
+
+bool detail::iequals_narrow( string_view s1, string_view s2 ) {
+    if( s1.size() != s2.size() )
+        return false;
+    auto i = fold_mismatch( s1.data(), s2.data(), s1.size() );
+    if( i == s1.size() )
+        return true;
+    // The two differ at i even after folding ASCII case, but  they
+    // might still be equal if the locale folds non-ASCII bytes.
+    if( is_ascii( s1[i] ) && is_ascii( s2[i] ) )
+        return false;
+    return iequals_locale( s1.substr( i ), s2.substr( i ) );
+}
+
+bool icontains( string_view s, string_view what ) {
+    size_t const n = what.size();
+    if( n == 0 )
+        return true;
+    if( n > s.size() )
+        return false;
+    size_t i = 0;
+#if UTIL_SIMD_X86
+    // The vectorized search relies on the ends of `what` only match-
+    // ing bytes that fold to the same thing as they do.
+    if( is_ascii( what.front() ) && is_ascii( what.back() ) ) {
+        char first = fold_ascii( what.front() );
+        char last  = fold_ascii( what.back() );
+#   if UTIL_SIMD_AVX2
+        if( simd::has_avx2() &&
+            find_folded_avx2( s, what, first, last, i ) )
+            return true;
+#   endif
+        if( find_folded_sse2( s, what, first, last, i ) )
+            return true;
+    }
+#endif
+    for( ; i + n <= s.size(); ++i )
+        if( detail::iequals_narrow( s.substr( i, n ), what ) )
+            return true;
+    return false;
+}
+
+bool istarts_with( string_view s, string_view what ) {
+    return what.size() <= s.size() &&
+           detail::iequals_narrow( s.substr( 0, what.size() ), what );
+}
+
+bool iends_with( string_view s, string_view what ) {
+    return what.size() <= s.size() &&
+           detail::iequals_narrow( s.substr( s.size()-what.size() ),
+                                   what );
+}
+
 // Strip all blank space off of  a  string  view and return a new
 // one.
 string_view strip( string_view sv ) {
@@ -41,20 +258,75 @@ string_view strip( string_view sv ) {
     return sv;
 }
 
+/****************************************************************
+* SplitView
+****************************************************************/
+detail::SplitSpec::SplitSpec( string_view sv_, string_view chars,
+                              bool strip_ )
+  : sv( sv_ ), strip( strip_ ) {
+    for( unsigned char c : chars )
+        table[c >> 6] |= uint64_t( 1 ) << ( c & 63 );
+    if( chars.size() == 1 )
+        single = (unsigned char)chars[0];
+}
+
+size_t detail::SplitSpec::find_delim( string_view s ) const {
+    if( single >= 0 ) {
+        auto pos = s.find( char( single ) );
+        return ( pos == string_view::npos ) ? s.size() : pos;
+    }
+    size_t i = 0;
+    for( ; i < s.size(); ++i ) {
+        auto c = (unsigned char)s[i];
+        if( ( table[c >> 6] >> ( c & 63 ) ) & 1 )
+            break;
+    }
+    return i;
+}
+
+void SplitView::iterator::advance() {
+    while( true ) {
+        if( m_next == string_view::npos ) {
+            m_done = true;
+            return;
+        }
+        auto rest = m_spec.sv.substr( m_next );
+        auto len  = m_spec.find_delim( rest );
+        m_piece   = rest.substr( 0, len );
+        m_next    = ( len == rest.size() ) ? string_view::npos
+                                           : m_next + len + 1;
+        if( !m_spec.strip )
+            return;
+        m_piece = strip( m_piece );
+        if( !m_piece.empty() )
+            return;
+    }
+}
+
+SplitView split_view( string_view sv, char c ) {
+    return SplitView( sv, string_view( &c, 1 ), /*strip=*/false );
+}
+
+SplitView split_view( string_view sv, string_view chars ) {
+    return SplitView( sv, chars, /*strip=*/false );
+}
+
+SplitView split_strip_view( string_view sv, char c ) {
+    return SplitView( sv, string_view( &c, 1 ), /*strip=*/true );
+}
+
+SplitView split_strip_view( string_view sv, string_view chars ) {
+    return SplitView( sv, chars, /*strip=*/true );
+}
+
 // Split a string on any character from the list. NOTE: this does
 // not split on the `chars` string as a whole, it splits on any
 // of the individual characters in the `chars`.
 vector<string_view>
 split_on_any( string_view sv, string_view chars ) {
     vector<string_view> res;
-    while( true ) {
-        auto next = sv.find_first_of( chars );
-        if( next == string_view::npos ) break;
-        res.push_back( sv.substr( 0, next ) );
-        // Remove what we just added, plus c
-        sv.remove_prefix( next+1 );
-    }
-    res.push_back( sv );
+    for( auto piece : split_view( sv, chars ) )
+        res.push_back( piece );
     return res;
 }
 
@@ -67,35 +339,139 @@ vector<string_view> split( string_view sv, char c ) {
 // from result.
 vector<string_view> split_strip_any( string_view sv,
                                      string_view chars ) {
-    auto res = split_on_any( sv, chars );
-    transform( begin( res ), end( res ), begin( res ), strip );
-    auto new_end = std::remove_if(
-            begin( res ), end( res ),
-            []( auto const& _ ){ return _.empty(); } );
-    res.erase( new_end, end( res ) );
+    vector<string_view> res;
+    for( auto piece : split_strip_view( sv, chars ) )
+        res.push_back( piece );
     return res;
 }
 
+/****************************************************************
+* Common prefix
+****************************************************************/
+namespace {
+
+#if UTIL_SIMD_X86
+// These advance i over blocks of bytes in which a and b  are  the
+// same, and return true (with i at the position of the difference)
+// if they find a block in which they aren't.
+bool mismatch_sse2( char const* a, char const* b, size_t n,
+                    size_t& i ) {
+    for( ; i + 16 <= n; i += 16 ) {
+        auto x = _mm_loadu_si128( (__m128i const*)( a+i ) );
+        auto y = _mm_loadu_si128( (__m128i const*)( b+i ) );
+        auto ne = uint32_t( _mm_movemask_epi8(
+                      _mm_cmpeq_epi8( x, y ) ) ) ^ 0xffff;
+        if( ne ) {
+            i += countr_zero( ne );
+            return true;
+        }
+    }
+    return false;
+}
+#endif
+
+#if UTIL_SIMD_AVX2
+UTIL_TARGET_AVX2
+bool mismatch_avx2( char const* a, char const* b, size_t n,
+                    size_t& i ) {
+    for( ; i + 32 <= n; i += 32 ) {
+        auto x = _mm256_loadu_si256( (__m256i const*)( a+i ) );
+        auto y = _mm256_loadu_si256( (__m256i const*)( b+i ) );
+        auto ne = ~uint32_t( _mm256_movemask_epi8(
+                      _mm256_cmpeq_epi8( x, y ) ) );
+        if( ne ) {
+            i += countr_zero( ne );
+            return true;
+        }
+    }
+    return false;
+}
+#endif
+
+// Length of the longest common prefix of a and b.
+size_t prefix_length( string_view a, string_view b ) {
+    size_t n = min( a.size(), b.size() );
+    size_t i = 0;
+#if UTIL_SIMD_AVX2
+    if( simd::has_avx2() && mismatch_avx2( a.data(), b.data(), n, i ) )
+        return i;
+#endif
+#if UTIL_SIMD_X86
+    if( mismatch_sse2( a.data(), b.data(), n, i ) )
+        return i;
+#endif
+    while( i < n && a[i] == b[i] ) ++i;
+    return i;
+}
+
+// Inputs with fewer than this many strings per job are not worth
+// splitting up.
+constexpr size_t min_strings_per_job = 1 << 14;
+
+// The lexicographically smallest and largest of strings[start,end).
+template<typename Strings>
+pair<string_view, string_view> min_max_strings(
+        Strings const& strings, size_t start, size_t end ) {
+    string_view lo = strings[start], hi = strings[start];
+    for( size_t i = start+1; i < end; ++i ) {
+        string_view s = strings[i];
+        if( s < lo )
+            lo = s;
+        else if( s > hi )
+            hi = s;
+    }
+    return { lo, hi };
+}
+
+template<typename Strings>
+optional<string_view> common_prefix_view_impl(
+        Strings const& strings, int jobs_in ) {
+    ASSERT_( jobs_in >= 0 );
+    if( strings.empty() )
+        return nullopt;
+    size_t size = strings.size();
+
+    pair<string_view, string_view> lo_hi;
+    if( jobs_in == 1 || size < 2*min_strings_per_job ) {
+        lo_hi = min_max_strings( strings, 0, size );
+    } else {
+        auto&  pool = par::default_pool();
+        size_t jobs = min( par::detail::num_jobs( pool, jobs_in ),
+                           size/min_strings_per_job );
+        vector<pair<string_view, string_view>> results( jobs );
+        par::for_ranges( pool, size, jobs, par::Schedule::STATIC,
+            [&]( size_t job, size_t start, size_t end ) {
+                results[job] = min_max_strings( strings, start, end );
+                return true;
+            } );
+        lo_hi = results[0];
+        for( auto [lo, hi] : results ) {
+            lo_hi.first  = min( lo_hi.first,  lo );
+            lo_hi.second = max( lo_hi.second, hi );
+        }
+    }
+    string_view first = strings[0];
+    return first.substr( 0, prefix_length( lo_hi.first,
+                                           lo_hi.second ) );
+}
+
+} // namespace
+
+optional<string_view> common_prefix_view(
+        vector<string_view> const& strings, int jobs ) {
+    return common_prefix_view_impl( strings, jobs );
+}
+
+optional<string_view> common_prefix_view(
+        vector<string> const& strings, int jobs ) {
+    return common_prefix_view_impl( strings, jobs );
+}
+
 optional<string> common_prefix( vector<string> const& strings ) {
-  optional<string> res;
-  if( strings.empty() ) return res;
-  int min_size = std::numeric_limits<int>::max();
-  for( auto const& s : strings )
-    min_size = std::min( min_size, int( s.size() ) );
-  int max_prefix_size = min_size;
-  string prefix; prefix.reserve( max_prefix_size );
-  int curr_pos = 0;
-  while( curr_pos < max_prefix_size ) {
-    char proposed_next_char = strings[0][curr_pos];
-    for( auto const& s : strings )
-      if( s[curr_pos] != proposed_next_char )
-        goto finished;
-    prefix.push_back( proposed_next_char );
-    ++curr_pos;
-  }
-finished:
-  res = prefix;
-  return res;
+    auto res = common_prefix_view( strings );
+    if( !res )
+        return nullopt;
+    return string( *res );
 }
 
 // Split  a  string, strip all elements, and remove empty strings
@@ -106,28 +482,28 @@ vector<string_view> split_strip( string_view sv, char c ) {
 
 vector<string> wrap_text_fn( string_view text,
                              IsStrOkFunc const& is_ok ) {
-  auto words = util::split_strip_any( text, " \n\r\t" );
   vector<string> res;
   string line;
-  for( auto const& word : words ) {
-    string proposed;
-    proposed = line;
-    if( proposed.empty() )
-        proposed = word;
-    else
-        proposed += ' ' + string( word );
-
-    if( is_ok( proposed ) ) {
-        line = proposed;
+  for( auto word : util::split_strip_view( text, " \n\r\t" ) ) {
+    // Try the word out on the end of the current line, and  take
+    // it back off if it does not fit; this way we don't copy the
+    // line for every word.
+    size_t old_size = line.size();
+    if( !line.empty() )
+        line += ' ';
+    line += word;
+
+    if( is_ok( line ) )
+        continue;
+    if( old_size == 0 ) {
+        // word on its own line.
+        res.emplace_back( std::move( line ) );
+        line.clear();
     } else {
-        if( line.empty() )
-            // word on its own line.
-            res.emplace_back( std::move( proposed ) );
-        else {
-            // push current line and put new word on next line.
-            res.emplace_back( std::move( line ) );
-            line = word;
-        }
+        // push current line and put new word on next line.
+        line.resize( old_size );
+        res.emplace_back( std::move( line ) );
+        line = word;
     }
   }
   if( !line.empty() )
@@ -135,10 +511,102 @@ vector<string> wrap_text_fn( string_view text,
   return res;
 }
 
-vector<string> wrap_text( string_view text, int max_length ) {
-    return wrap_text_fn( text, [max_length]( string_view sv ) {
-        return int( sv.size() ) <= max_length;
-    });
+namespace {
+
+// Decides where to break the lines and returns the index of  the
+// first word on each line. This works only with the  lengths  of
+// the words, with the length of a line being the  sum  of  the
+// lengths of its words plus one for each space between them.
+vector<size_t> wrap_breaks( vector<string_view> const& words,
+                            size_t max_length, WrapMode mode ) {
+  vector<size_t> starts;
+  if( words.empty() )
+      return starts;
+
+  switch( mode ) {
+    case WrapMode::GREEDY: {
+      size_t len = 0;
+      for( size_t i = 0; i < words.size(); ++i ) {
+        size_t w = words[i].size();
+        if( i == 0 || len + 1 + w > max_length ) {
+          starts.push_back( i );
+          len = w;
+        } else {
+          len += 1 + w;
+        }
+      }
+      break;
+    }
+    case WrapMode::MIN_RAGGED: {
+      size_t n = words.size();
+      // cost[e] is the minimum cost of laying out words [0,e)  and
+      // from[e] is the first word of the last line in that layout.
+      vector<uint64_t> cost( n+1, numeric_limits<uint64_t>::max() );
+      vector<size_t>   from( n+1, 0 );
+      cost[0] = 0;
+      for( size_t e = 1; e <= n; ++e ) {
+        size_t len = 0;
+        for( size_t s = e; s-- > 0; ) {
+          len += words[s].size() + ( s+1 < e ? 1 : 0 );
+          // A line may only overflow if it holds a single word.
+          if( len > max_length && s+1 < e )
+            break;
+          uint64_t slack = len < max_length ? max_length-len : 0;
+          // The last line does not count, since it  is  expected
+          // to be short.
+          uint64_t c = cost[s] + ( e == n ? 0 : slack*slack );
+          if( c < cost[e] ) {
+            cost[e] = c;
+            from[e] = s;
+          }
+        }
+      }
+      for( size_t e = n; e > 0; e = from[e] )
+        starts.push_back( from[e] );
+      reverse( starts.begin(), starts.end() );
+      break;
+    }
+  }
+  return starts;
+}
+
+} // namespace
+
+vector<string> wrap_text( string_view text, int max_length,
+                          WrapMode mode ) {
+  auto words  = util::split_strip_any( text, " \n\r\t" );
+  auto starts = wrap_breaks( words, size_t( max( max_length, 0 ) ),
+                             mode );
+  vector<string> res; res.reserve( starts.size() );
+  for( size_t l = 0; l < starts.size(); ++l ) {
+    size_t end = ( l+1 < starts.size() ) ? starts[l+1] : words.size();
+    size_t len = end - starts[l] - 1;
+    for( size_t i = starts[l]; i < end; ++i )
+      len += words[i].size();
+    string& line = res.emplace_back();
+    line.reserve( len );
+    for( size_t i = starts[l]; i < end; ++i ) {
+      if( i != starts[l] )
+        line += ' ';
+      line += words[i];
+    }
+  }
+  return res;
+}
+
+vector<string_view> wrap_text_views( string_view text,
+                                     int max_length, WrapMode mode ) {
+  auto words  = util::split_strip_any( text, " \n\r\t" );
+  auto starts = wrap_breaks( words, size_t( max( max_length, 0 ) ),
+                             mode );
+  vector<string_view> res; res.reserve( starts.size() );
+  for( size_t l = 0; l < starts.size(); ++l ) {
+    size_t end = ( l+1 < starts.size() ) ? starts[l+1] : words.size();
+    char const* first = words[starts[l]].data();
+    char const* last  = words[end-1].data() + words[end-1].size();
+    res.emplace_back( first, size_t( last-first ) );
+  }
+  return res;
 }
 
 // Convert element type.
@@ -167,6 +635,31 @@ vector<fs::path> to_paths( vector<string> const& ss ) {
 /****************************************************************
 * To-String utilities
 ****************************************************************/
+namespace {
+
+// Appends the result of std::to_chars( first, last, args... ) to
+// `out`, formatting directly into the string's storage. `guess`
+// should be enough room for most values; if it turns  out  not  to
+// be then we grow to `max_len`, which must always be enough.
+template<typename... Args>
+void append_chars( string& out, size_t guess, size_t max_len,
+                   Args... args ) {
+  size_t old = out.size();
+  for( size_t room : { guess, max_len } ) {
+    out.resize( old+room );
+    auto [ptr, ec] = to_chars( out.data()+old,
+                               out.data()+out.size(), args... );
+    if( ec == errc() ) {
+      out.resize( size_t( ptr-out.data() ) );
+      return;
+    }
+  }
+  out.resize( old );
+  ASSERT( false, "to_chars failed to format a number." );
+}
+
+} // namespace
+
 // NOTE: These puts quotes around the string! The reason for this
 // behavior  is that we want to try to perform the to_string oper-
 // ation  (in general) such that it has some degree of reversibil-
@@ -176,16 +669,30 @@ vector<fs::path> to_paths( vector<string> const& ss ) {
 // convert  back, at least approximately). So therefore, whenever
 // the  to_string methods convert a already-string-like entity to
 // a string, it will insert quotes in the string itself.
+void to_string_into( string& out, string_view const& s ) {
+    out.reserve( out.size() + s.size() + 2 );
+    out += '"';
+    out += s;
+    out += '"';
+}
+
+void to_string_into( string& out, string const& s ) {
+    to_string_into( out, string_view( s ) );
+}
+
+void to_string_into( string& out, char const* s ) {
+    to_string_into( out, string_view( s ) );
+}
+
 string to_string( string const& s ) {
-    string res =  "\"";
-    res += s;
-    res += "\"";
-    return res;
+    string res; to_string_into( res, s ); return res;
 }
 string to_string( string_view const& s ) {
-    // Below may seem redundant, but we want to put quotes around
-    // the string.
-    return to_string( string( s ) );
+    string res; to_string_into( res, s ); return res;
+}
+
+void to_string_into( string& out, Error const& e ) {
+    out += e.msg;
 }
 
 std::string to_string( Error const& e ) { return e.msg; }
@@ -197,24 +704,37 @@ std::string to_string( Error const& e ) { return e.msg; }
 // is not doing what we want). But  having this one causes gcc to
 // select it when we give it a string literal.
 std::string to_string( char const* s ) {
-    string res = "\"";
-    res += string( s );
-    res += "\"";
-    return res;
+    string res; to_string_into( res, s ); return res;
 }
 
 // NOTE: This puts single quotes around the character!
-string to_string( char const& s ) {
-    string res( 1, s );
-    return "'" + res + "'";
+void to_string_into( string& out, char const& c ) {
+    out += '\'';
+    out += c;
+    out += '\'';
+}
+
+string to_string( char const& c ) {
+    string res; to_string_into( res, c ); return res;
+}
+
+void to_string_into( string& out, int i ) {
+  // Sign plus ten digits.
+  append_chars( out, 11, 11, i );
 }
 
 std::string to_string( int i ) {
-  return std::to_string( i );
+  string res; to_string_into( res, i ); return res;
+}
+
+// Formatted the same as std::to_string (i.e., "%f"). Fixed nota-
+// tion of the largest double has 309 integral digits.
+void to_string_into( string& out, double d ) {
+  append_chars( out, 32, 320, d, chars_format::fixed, 6 );
 }
 
 std::string to_string( double d ) {
-  return std::to_string( d );
+  string res; to_string_into( res, d ); return res;
 }
 
 // Note two important things about this function: 1) it will will
@@ -224,11 +744,17 @@ std::string to_string( double d ) {
 // Also, it will put quotes around it. To convert  a  path  to  a
 // string without quotes use the  path's  string() method (or one
 // of its variants).
+void to_string_into( string& out, fs::path const& p ) {
+#ifdef _WIN32
+    to_string_into( out, string_view( p.string() ) );
+#else
+    // Already narrow, so no need to make a copy.
+    to_string_into( out, string_view( p.native() ) );
+#endif
+}
+
 string to_string( fs::path const& p ) {
-    string res = "\"";
-    res += p.string();
-    res += "\"";
-    return res;
+    string res; to_string_into( res, p ); return res;
 }
 
 // Will output a local time with format:
@@ -237,6 +763,12 @@ string to_string( fs::path const& p ) {
 //
 // where there is no information  about  time  zone assumed or at-
 // tached to the result.
+void to_string_into( string& out, SysTimePoint const& p ) {
+    array<char, fmt_time_length> buf;
+    util::fmt_time_into( buf, p );
+    out.append( buf.data(), buf.size() );
+}
+
 string to_string( SysTimePoint const& p ) {
     return util::fmt_time( p );
 }
@@ -247,6 +779,11 @@ string to_string( SysTimePoint const& p ) {
 //
 // where the date and time are adjusted so as to output it in the
 // UTC time zone (hence the +0000 at the end).
+void to_string_into( string& out, ZonedTimePoint const& p ) {
+    to_string_into( out, p.to_local( util::tz_utc() ) );
+    out += util::tz_hhmm( util::tz_utc() );
+}
+
 string to_string( ZonedTimePoint const& p ) {
     return util::fmt_time( p, util::tz_utc() );
 }
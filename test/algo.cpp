@@ -7,6 +7,18 @@
 #include "base-util/algo-par.hpp"
 #include "base-util/string.hpp"
 
+#include <array>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <deque>
+#include <limits>
+#include <numeric>
+#include <random>
+#include <span>
+#include <string_view>
+#include <thread>
+
 using namespace std;
 
 TEST_CASE( "group_by_key" )
@@ -531,3 +543,311 @@ TEST_CASE( "map_par_safe" )
     REQUIRE( res_v7[3] == util::Result<fs::path>( "3" ) );
     REQUIRE( res_v7[4] == util::Result<fs::path>( "2" ) );
 }
+
+TEST_CASE( "thread_pool" )
+{
+    util::par::ThreadPool pool( 2 );
+    REQUIRE( pool.size() == 2 );
+
+    // Run many small batches to exercise reuse of the workers.
+    vector<int> v( 100 );
+    for( int i = 0; i < 100; ++i ) v[i] = i;
+    auto sq = []( int x ){ return x*x; };
+    for( int round = 0; round < 50; ++round ) {
+        auto res = util::par::map( pool, sq, v );
+        REQUIRE( res.size() == 100 );
+        REQUIRE( res[99] == 99*99 );
+    }
+
+    // Explicit pool with map_safe and for_each.
+    auto res_safe = util::par::map_safe( pool, sq, v, 3 );
+    REQUIRE( res_safe[7] == util::Result<int>( 49 ) );
+
+    atomic<int> sum{ 0 };
+    util::par::for_each( pool, v, [&]( int x ){ sum += x; } );
+    REQUIRE( sum == 4950 );
+
+    // Nested parallelism must not deadlock even when every worker
+    // is busy running an outer job.
+    auto outer = [&]( int x ){
+        auto inner = util::par::map( pool, sq, vector<int>{ x, x } );
+        return inner[0] + inner[1];
+    };
+    auto nested = util::par::map( pool, outer, vector{ 1, 2, 3, 4 } );
+    REQUIRE( nested == (vector{ 2, 8, 18, 32 }) );
+
+    // Exceptions thrown by jobs are propagated by run().
+    vector<function<void()>> funcs{
+        []{},
+        []{ throw runtime_error( "job failed" ); },
+        []{} };
+    REQUIRE_THROWS_WITH( pool.run( funcs ), "job failed" );
+
+    // The default pool has already been created by other tests so
+    // it is too late to resize it.
+    (void)util::par::default_pool();
+    REQUIRE_THROWS( util::par::set_default_pool_size( 2 ) );
+}
+
+TEST_CASE( "par_stealing" )
+{
+    using util::par::Schedule;
+
+    auto inc = []( int x ){ return x+1; };
+
+    vector<int> v;
+    vector<int> goal;
+    for( int i = 0; i < 1000; ++i ) {
+        v.push_back( i );
+        goal.push_back( i+1 );
+    }
+
+    REQUIRE( util::par::map( inc, vector<int>{}, 0,
+                             Schedule::STEALING ).empty() );
+    for( int jobs : { 0, 1, 2, 3, 7, 2000 } )
+        REQUIRE( util::par::map( inc, v, jobs,
+                                 Schedule::STEALING ) == goal );
+
+    // Make a few elements much more expensive than the rest, all
+    // of them in the first job's range, and check  that  every
+    // element is still visited exactly once.
+    vector<atomic<int>> visits( v.size() );
+    auto skewed = [&]( int i ){
+        if( i % 100 == 0 && i < 200 )
+            this_thread::sleep_for( chrono::milliseconds( 5 ) );
+        visits[i]++;
+    };
+    util::par::for_each( v, skewed, 4, Schedule::STEALING );
+    REQUIRE( all_of( visits.begin(), visits.end(),
+                     []( auto const& n ){ return n == 1; } ) );
+
+    // Errors are reported the same way as with STATIC.
+    auto inc_err = []( int x ){
+        ASSERT_( x != 500 );
+        return x+1;
+    };
+    REQUIRE_THROWS( util::par::map( inc_err, v, 0,
+                                    Schedule::STEALING ) );
+    REQUIRE_THROWS( util::par::for_each( v, inc_err, 3,
+                                         Schedule::STEALING ) );
+    auto res = util::par::map_safe( inc_err, v, 0,
+                                    Schedule::STEALING );
+    REQUIRE( res.size() == 1000 );
+    REQUIRE( holds_alternative<util::Error>( res[500] ) );
+    REQUIRE( res[501] == util::Result<int>( 502 ) );
+}
+
+TEST_CASE( "par_ranges" )
+{
+    auto inc = []( int x ){ return x+1; };
+
+    vector<int> goal{ 2, 3, 4, 5, 6 };
+
+    // Containers other than vector.
+    deque<int> d{ 1, 2, 3, 4, 5 };
+    REQUIRE( util::par::map( inc, d, 2 ) == goal );
+    array<int, 5> a{ 1, 2, 3, 4, 5 };
+    REQUIRE( util::par::map( inc, a ) == goal );
+
+    // A span over part of a vector, so nothing is copied.
+    vector<int> v{ 0, 1, 2, 3, 4, 5, 6 };
+    span<int const> s( v.data()+1, 5 );
+    REQUIRE( util::par::map( inc, s, 3 ) == goal );
+
+    // Result type differs from element type.
+    string_view sv = "abc";
+    auto up = []( char c ){ return string( 1, char( toupper( c ) ) ); };
+    REQUIRE( util::par::map( up, sv ) == vector<string>{ "A", "B", "C" } );
+
+    // Iterator pairs.
+    REQUIRE( util::par::map( inc, v.begin()+1, v.begin()+6 ) == goal );
+    REQUIRE( util::par::map( inc, v.begin(), v.begin() ).empty() );
+    auto res_safe = util::par::map_safe( inc, d.begin(), d.end(), 2 );
+    REQUIRE( res_safe.size() == 5 );
+    REQUIRE( res_safe[4] == util::Result<int>( 6 ) );
+    atomic<int> sum{ 0 };
+    util::par::for_each( d.cbegin()+1, d.cend(),
+                         [&]( int x ){ sum += x; }, 3 );
+    REQUIRE( sum == 14 );
+
+    // Output into a caller-supplied range.
+    vector<long> out( 7, -1 );
+    util::par::map_into( inc, s, span<long>( out.data()+1, 5 ), 2 );
+    REQUIRE( out == vector<long>{ -1, 2, 3, 4, 5, 6, -1 } );
+    util::par::ThreadPool pool( 2 );
+    array<int, 5> out_a{};
+    util::par::map_into( pool, inc, a, out_a, 0,
+                         util::par::Schedule::STEALING );
+    REQUIRE( vector<int>( out_a.begin(), out_a.end() ) == goal );
+    // Output smaller than input.
+    REQUIRE_THROWS( util::par::map_into( inc, v, out_a ) );
+    // Errors are rethrown.
+    auto inc_err = []( int x ){
+        ASSERT_( x != 3 );
+        return x+1;
+    };
+    REQUIRE_THROWS( util::par::map_into( inc_err, a, out_a ) );
+}
+
+TEST_CASE( "par_reduce" )
+{
+    vector<int> v( 1000 );
+    iota( v.begin(), v.end(), 1 );
+
+    REQUIRE( util::par::reduce( vector<int>{}, 5 ) == 5 );
+    REQUIRE( util::par::reduce( v, 0 ) == 500500 );
+    for( int jobs : { 1, 2, 3, 7, 2000 } )
+        REQUIRE( util::par::reduce( v, 10L, plus<>{}, jobs ) == 500510 );
+
+    // Non-commutative op: the order of elements must be preserved.
+    vector<string> strs{ "a", "b", "c", "d", "e", "f", "g" };
+    auto cat = []( string const& l, string const& r ){ return l+r; };
+    for( int jobs : { 1, 2, 3, 7 } )
+        REQUIRE( util::par::reduce( strs, string( ">" ), cat, jobs ) ==
+                 ">abcdefg" );
+
+    auto sq = []( int x ){ return long( x )*x; };
+    util::par::ThreadPool pool( 3 );
+    REQUIRE( util::par::transform_reduce( pool, v, 0L, plus<>{}, sq ) ==
+             333833500L );
+    REQUIRE( util::par::transform_reduce( string_view( "abc" ),
+                 string(), cat, []( char c ){ return string( 2, c ); },
+                 2 ) == "aabbcc" );
+
+    auto sq_err = []( int x ){
+        ASSERT_( x != 700 );
+        return long( x )*x;
+    };
+    REQUIRE_THROWS( util::par::transform_reduce( v, 0L, plus<>{},
+                                                 sq_err ) );
+}
+
+TEST_CASE( "par_scan" )
+{
+    vector<int> v( 1000 );
+    iota( v.begin(), v.end(), 1 );
+
+    vector<int> incl( v.size() ), excl( v.size() );
+    partial_sum( v.begin(), v.end(), incl.begin() );
+    excl[0] = 3;
+    for( size_t i = 1; i < v.size(); ++i )
+        excl[i] = excl[i-1] + v[i-1];
+
+    for( int jobs : { 0, 1, 2, 3, 7, 2000 } ) {
+        vector<int> out( v.size() );
+        util::par::inclusive_scan( v, out, plus<>{}, jobs );
+        REQUIRE( out == incl );
+        util::par::exclusive_scan( v, out, 3, plus<>{}, jobs );
+        REQUIRE( out == excl );
+    }
+
+    // In place.
+    vector<int> w = v;
+    util::par::ThreadPool pool( 2 );
+    util::par::inclusive_scan( pool, w, w );
+    REQUIRE( w == incl );
+
+    // Empty input.
+    vector<int> empty;
+    util::par::inclusive_scan( empty, empty );
+    util::par::exclusive_scan( empty, empty, 0 );
+    REQUIRE( empty.empty() );
+
+    // Non-commutative op.
+    vector<string> strs{ "a", "b", "c", "d", "e" };
+    auto cat = []( string const& l, string const& r ){ return l+r; };
+    vector<string> out_s( 5 );
+    util::par::inclusive_scan( strs, out_s, cat, 3 );
+    REQUIRE( out_s == vector<string>{ "a", "ab", "abc", "abcd",
+                                      "abcde" } );
+    util::par::exclusive_scan( strs, out_s, string( ">" ), cat, 2 );
+    REQUIRE( out_s == vector<string>{ ">", ">a", ">ab", ">abc",
+                                      ">abcd" } );
+
+    // Errors.
+    vector<int> small( 10 );
+    REQUIRE_THROWS( util::par::inclusive_scan( v, small ) );
+    auto plus_err = []( int l, int r ){
+        ASSERT_( r != 500 );
+        return l+r;
+    };
+    vector<int> out( v.size() );
+    REQUIRE_THROWS( util::par::inclusive_scan( v, out, plus_err, 4 ) );
+}
+
+TEST_CASE( "par_sorting" )
+{
+    // Large enough to take the parallel paths.
+    size_t const n = 50000;
+    mt19937      gen( 1234 );
+
+    vector<int> v( n );
+    for( auto& x : v ) x = int( gen() ) % 1000000;
+    for( int jobs : { 0, 1, 2, 3, 8 } ) {
+        auto w = v, goal = v;
+        util::par::sort( w, jobs );
+        std::sort( goal.begin(), goal.end() );
+        REQUIRE( w == goal );
+    }
+
+    vector<int64_t> v64( n );
+    for( auto& x : v64 ) x = int64_t( gen() ) - int64_t( gen() )*1000003;
+    v64[7] = numeric_limits<int64_t>::min();
+    v64[8] = numeric_limits<int64_t>::max();
+    auto goal64 = v64;
+    std::sort( goal64.begin(), goal64.end() );
+    util::par::ThreadPool pool( 3 );
+    util::par::sort( pool, v64 );
+    REQUIRE( v64 == goal64 );
+
+    vector<unsigned char> bytes( n );
+    for( auto& b : bytes ) b = (unsigned char)( gen() );
+    REQUIRE_FALSE( is_sorted( bytes.begin(), bytes.end() ) );
+    util::par::sort( bytes, 4 );
+    REQUIRE( is_sorted( bytes.begin(), bytes.end() ) );
+
+    vector<string> strs( n );
+    for( auto& s : strs ) s = to_string( gen() % 10000 );
+    auto goal_strs = strs;
+    std::sort( goal_strs.begin(), goal_strs.end() );
+    util::par::sort( strs, 5 );
+    REQUIRE( strs == goal_strs );
+
+    // Small inputs.
+    vector<int> small{ 4, 7, 3, 6, 4, 7, 5, 2, 4, 5, 2 };
+    util::par::sort( small );
+    REQUIRE( small == vector{ 2, 2, 3, 4, 4, 4, 5, 5, 6, 7, 7 } );
+    vector<int> empty;
+    util::par::sort( empty );
+    REQUIRE( empty.empty() );
+
+    small = { 4, 7, 3, 6, 4, 7, 5, 2, 4, 5, 2 };
+    util::par::uniq_sort( small );
+    REQUIRE( small == vector{ 2, 3, 4, 5, 6, 7 } );
+    auto uniq = v;
+    util::par::uniq_sort( uniq, 3 );
+    auto goal_uniq = v;
+    util::uniq_sort( goal_uniq );
+    REQUIRE( uniq == goal_uniq );
+
+    // sort_by_key is stable and calls the key function once per
+    // element.
+    auto check_by_key = [&]( auto key_func, int jobs ) {
+        atomic<size_t> calls{ 0 };
+        auto counted = [&]( int x ){ ++calls; return key_func( x ); };
+        auto w = v, goal = v;
+        util::par::sort_by_key( w, counted, jobs );
+        util::stable_sort_by_key( goal, key_func );
+        REQUIRE( w == goal );
+        REQUIRE( calls == n );
+    };
+    check_by_key( []( int x ){ return x % 7 - 3; }, 0 );
+    check_by_key( []( int x ){ return x % 7 - 3; }, 4 );
+    check_by_key( []( int x ){ return to_string( x % 1000 ); }, 3 );
+    check_by_key( []( int x ){ return double( x % 100 ); }, 1 );
+
+    vector<string> small_strs{ "ccc", "a", "bb", "dd", "e" };
+    util::par::sort_by_key( small_strs,
+                            []( string const& s ){ return s.size(); } );
+    REQUIRE( small_strs == vector<string>{ "a", "e", "bb", "dd", "ccc" } );
+}
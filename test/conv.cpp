@@ -56,4 +56,8 @@ TEST_CASE( "ascii_2_utf16le" )
     REQUIRE( v[5]  == _0  );
     REQUIRE( v[16] == 'l' );
     REQUIRE( v[17] == _0  );
+
+    util::MappedFile m( ::data_common/"3-lines.txt" );
+    auto from_mapped = conv::ascii_2_utf16le( m, true );
+    REQUIRE( from_mapped == v );
 }
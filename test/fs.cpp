@@ -6,14 +6,23 @@
 #include "infra/common.hpp"
 
 #include "base-util/fs.hpp"
+#include "base-util/glob.hpp"
 #include "base-util/line-endings.hpp"
 #include "base-util/logger.hpp"
 #include "base-util/io.hpp"
 #include "base-util/string.hpp"
 #include "base-util/misc.hpp"
+#include "base-util/path-table.hpp"
 
+#include <array>
+#include <deque>
+#include <random>
 #include <thread>
 
+#ifndef _WIN32
+#   include <unistd.h>
+#endif
+
 using namespace std;
 
 // Utility macro used to wrap string literals containing absolute
@@ -54,6 +63,23 @@ TEST_CASE( "wildcard" )
 
     REQUIRE_THROWS( util::wildcard( "x/y/z/*" ) );
 
+    // Relative paths through and around the CWD.
+    auto here = fs::current_path().filename();
+    REQUIRE( util::wildcard( ".."/here, true ) == (PathVec{"."}) );
+    REQUIRE( util::wildcard( ".."/here, false ) == (PathVec{}) );
+    REQUIRE( util::wildcard( "../"+here.string()+"/test/?s.?pp" ) ==
+             (PathVec{"test/fs.cpp"}) );
+    REQUIRE( util::wildcard( "test/../test/?s.?pp" ) ==
+             (PathVec{"test/fs.cpp"}) );
+    REQUIRE( util::wildcard( "./test/infra/*.hpp" ) ==
+             (PathVec{"test/infra/common.hpp"}) );
+    auto up = util::wildcard( "../*", true );
+    REQUIRE( find( up.begin(), up.end(), fs::path( "." ) ) != up.end() );
+    REQUIRE( up.size() > 0 );
+    for( auto const& u : up )
+        if( u != "." )
+            REQUIRE( u.parent_path() == ".." );
+
     // Test that wildcard must match full filename.
     REQUIRE( util::wildcard( "test/e",  true ) == (PathVec{}) );
     REQUIRE( util::wildcard( "test/e*", true ) == (PathVec{}) );
@@ -73,6 +99,188 @@ TEST_CASE( "wildcard" )
 #endif
 }
 
+TEST_CASE( "wildcard_recursive" )
+{
+    auto folder = fs::temp_directory_path()/"wildcard-recursive";
+    fs::remove_all( folder );
+    fs::create_directories( folder/"src"/"a"/"b" );
+    fs::create_directories( folder/"src"/"c" );
+    fs::create_directories( folder/"doc" );
+    for( auto const& f : { "src/x.cpp", "src/x.hpp", "src/a/y.cpp",
+                           "src/a/b/z.cpp", "src/c/w.txt",
+                           "doc/d.cpp" } )
+        util::touch( folder/f );
+
+    auto& F = folder;
+    REQUIRE( util::wildcard_recursive( F/"src"/"**"/"*.cpp", true, 4 ) ==
+             (PathVec{ F/"src/a/b/z.cpp", F/"src/a/y.cpp",
+                       F/"src/x.cpp" }) );
+    REQUIRE( util::wildcard_recursive( F/"**"/"*.cpp", true, 1 ) ==
+             (PathVec{ F/"doc/d.cpp", F/"src/a/b/z.cpp",
+                       F/"src/a/y.cpp", F/"src/x.cpp" }) );
+    REQUIRE( util::wildcard_recursive( F/"*"/"*.cpp" ) ==
+             (PathVec{ F/"doc/d.cpp", F/"src/x.cpp" }) );
+    REQUIRE( util::wildcard_recursive( F/"src"/"**"/"b"/"*" ) ==
+             (PathVec{ F/"src/a/b/z.cpp" }) );
+    REQUIRE( util::wildcard_recursive( F/"src"/"*"/"**"/"*.cpp" ) ==
+             (PathVec{ F/"src/a/b/z.cpp", F/"src/a/y.cpp" }) );
+    REQUIRE( util::wildcard_recursive( F/"src"/"**"/"*.hpp" ) ==
+             (PathVec{ F/"src/x.hpp" }) );
+    REQUIRE( util::wildcard_recursive( F/"src"/"**"/"?" ) ==
+             (PathVec{ F/"src/a", F/"src/a/b", F/"src/c" }) );
+    REQUIRE( util::wildcard_recursive( F/"src"/"**"/"?", false ) ==
+             (PathVec{}) );
+    // A trailing ** matches everything below.
+    REQUIRE( util::wildcard_recursive( F/"src"/"c"/"**" ) ==
+             (PathVec{ F/"src/c/w.txt" }) );
+    REQUIRE( util::wildcard_recursive( F/"doc"/"**"/"**" ) ==
+             (PathVec{ F/"doc/d.cpp" }) );
+    REQUIRE( util::wildcard_recursive( F/"**"/"*.rs" ) == (PathVec{}) );
+    // No wildcards.
+    REQUIRE( util::wildcard_recursive( F/"src"/"x.cpp" ) ==
+             (PathVec{ F/"src/x.cpp" }) );
+    REQUIRE( util::wildcard_recursive( F/"src"/"q.cpp" ) == (PathVec{}) );
+    REQUIRE( util::wildcard_recursive( "" ) == (PathVec{}) );
+    REQUIRE_THROWS( util::wildcard_recursive( F/"missing"/"**" ) );
+
+    // Relative paths stay relative.
+    REQUIRE( util::wildcard_recursive( "test/**/fs.?pp" ) ==
+             (PathVec{ "test/fs.cpp" }) );
+
+    // Streaming.
+    int count = 0;
+    util::for_each_wildcard( F/"**",
+        [&]( fs::path const& ){ ++count; }, /*with_folders=*/false );
+    REQUIRE( count == 6 );
+    REQUIRE_THROWS( util::for_each_wildcard( F/"**",
+        []( fs::path const& ){ throw runtime_error( "stop" ); } ) );
+
+#ifndef _WIN32
+    // Symlinks are not followed.
+    fs::create_directory_symlink( folder/"src", folder/"doc"/"link" );
+    REQUIRE( util::wildcard_recursive( F/"doc"/"**"/"*.cpp" ) ==
+             (PathVec{ F/"doc/d.cpp" }) );
+    REQUIRE( util::wildcard_recursive( F/"doc"/"l*" ) ==
+             (PathVec{ F/"doc/link" }) );
+    // ...but a symlink to a folder is still a folder when it comes
+    // to leaving folders out, the same as in wildcard; a symlink to
+    // a file is not.
+    fs::create_symlink( folder/"doc"/"d.cpp", folder/"doc"/"lfile" );
+    REQUIRE( util::wildcard_recursive( F/"doc"/"l*", false ) ==
+             (PathVec{ F/"doc/lfile" }) );
+    REQUIRE( util::wildcard( F/"doc"/"l*", false ) ==
+             (PathVec{ F/"doc/lfile" }) );
+    REQUIRE( util::wildcard_recursive( F/"doc"/"*", false ) ==
+             util::wildcard( F/"doc"/"*", false ) );
+#endif
+
+    fs::remove_all( folder );
+}
+
+TEST_CASE( "glob" )
+{
+    using util::Glob;
+    auto yes = util::CaseSensitive::YES;
+    auto no  = util::CaseSensitive::NO;
+
+    REQUIRE(  Glob( "" ).matches( "" ) );
+    REQUIRE( !Glob( "" ).matches( "a" ) );
+    REQUIRE(  Glob( "*" ).matches( "" ) );
+    REQUIRE(  Glob( "*" ).matches( "abc" ) );
+    REQUIRE(  Glob( "***" ).matches( "abc" ) );
+    REQUIRE(  Glob( "abc" ).matches( "abc" ) );
+    REQUIRE( !Glob( "abc" ).matches( "abcd" ) );
+    REQUIRE( !Glob( "abc" ).matches( "ab" ) );
+    REQUIRE(  Glob( "a?c" ).matches( "abc" ) );
+    REQUIRE( !Glob( "a?c" ).matches( "ac" ) );
+    REQUIRE(  Glob( "*.?pp" ).matches( "fs.cpp" ) );
+    REQUIRE(  Glob( "*.?pp" ).matches( ".hpp" ) );
+    REQUIRE( !Glob( "*.?pp" ).matches( "fs.cp" ) );
+    REQUIRE(  Glob( "a*b*c" ).matches( "abc" ) );
+    REQUIRE(  Glob( "a*b*c" ).matches( "aXbYbZc" ) );
+    REQUIRE( !Glob( "a*b*c" ).matches( "aXbYcZ" ) );
+    REQUIRE(  Glob( "*a*a*a*b" ).matches( "aaaaaaaaaaaab" ) );
+    REQUIRE( !Glob( "*a*a*a*b" ).matches( "aaaaaaaaaaaaa" ) );
+    REQUIRE(  Glob( "x+y.(1)" ).matches( "x+y.(1)" ) );
+
+    // Character classes.
+    REQUIRE(  Glob( "[abc]" ).matches( "b" ) );
+    REQUIRE( !Glob( "[abc]" ).matches( "d" ) );
+    REQUIRE(  Glob( "file[0-9].txt" ).matches( "file7.txt" ) );
+    REQUIRE( !Glob( "file[0-9].txt" ).matches( "fileX.txt" ) );
+    REQUIRE(  Glob( "[!0-9]*" ).matches( "a1" ) );
+    REQUIRE( !Glob( "[!0-9]*" ).matches( "1a" ) );
+    REQUIRE(  Glob( "[^a]" ).matches( "b" ) );
+    REQUIRE( !Glob( "[^a]" ).matches( "a" ) );
+    REQUIRE(  Glob( "[]]" ).matches( "]" ) );
+    REQUIRE(  Glob( "[!]]" ).matches( "a" ) );
+    REQUIRE( !Glob( "[!]]" ).matches( "]" ) );
+    REQUIRE(  Glob( "[a-]" ).matches( "-" ) );
+    REQUIRE(  Glob( "[*?]" ).matches( "*" ) );
+    REQUIRE( !Glob( "[*?]" ).matches( "x" ) );
+    // An unterminated [ is a literal.
+    REQUIRE(  Glob( "a[b" ).matches( "a[b" ) );
+    REQUIRE( !Glob( "a[b" ).matches( "ab" ) );
+
+    // Case sensitivity.
+    REQUIRE(  Glob( "*.CPP", no  ).matches( "fs.cpp" ) );
+    REQUIRE( !Glob( "*.CPP", yes ).matches( "fs.cpp" ) );
+    REQUIRE(  Glob( "[a-c]x", no ).matches( "Bx" ) );
+    REQUIRE( !Glob( "[!a]", no ).matches( "A" ) );
+    REQUIRE(  Glob( "[!a]", yes ).matches( "A" ) );
+    REQUIRE( Glob( "x" ).case_sensitive() == !CASE_INSENSITIVE_FS() );
+
+    // Long patterns use a different matcher; they should agree.
+    string long_pat, long_str;
+    for( int i = 0; i < 40; ++i ) {
+        long_pat += "*a?";
+        long_str += "xxab";
+    }
+    Glob long_glob( long_pat );
+    REQUIRE(  long_glob.matches( long_str ) );
+    REQUIRE( !long_glob.matches( long_str.substr( 4 ) ) );
+    REQUIRE(  long_glob( "zz" + long_str ) );
+    REQUIRE( !long_glob( long_str + "zz" ) );
+
+    // Compare against a straightforward dynamic  programming  match
+    // on random inputs, with pattern lengths straddling the  limit
+    // of the bit-parallel matcher.
+    auto reference = []( string_view pat, string_view str ) {
+        // dp[j]: whether pat[0,i) matches str[0,j).
+        vector<bool> dp( str.size()+1, false );
+        dp[0] = true;
+        for( char p : pat ) {
+            vector<bool> next( str.size()+1, false );
+            for( size_t j = 0; j <= str.size(); ++j ) {
+                if( p == '*' )
+                    next[j] = dp[j] || ( j > 0 && next[j-1] );
+                else if( j > 0 )
+                    next[j] = dp[j-1] && ( p == '?' || p == str[j-1] );
+            }
+            dp = std::move( next );
+        }
+        return bool( dp[str.size()] );
+    };
+    mt19937 gen( 1 );
+    auto rand_str = [&]( size_t n, string_view alphabet ) {
+        string res;
+        for( size_t i = 0; i < n; ++i )
+            res += alphabet[gen() % alphabet.size()];
+        return res;
+    };
+    for( int i = 0; i < 500; ++i ) {
+        auto pat = rand_str( 1 + gen() % 90, "ab*??**" );
+        auto str = rand_str( gen() % 100, "ab" );
+        INFO( "pattern: " << pat << ", string: " << str );
+        REQUIRE( Glob( pat, yes ).matches( str ) ==
+                 reference( pat, str ) );
+    }
+
+    PathVec paths{ "a/x.cpp", "b/y.hpp", "z.cpp", "cpp" };
+    REQUIRE( Glob( "*.cpp" ).filter( paths ) ==
+             (PathVec{ "a/x.cpp", "z.cpp" }) );
+}
+
 TEST_CASE( "slashes" )
 {
     REQUIRE( util::fwd_slashes( "" ) == "" );
@@ -212,6 +420,211 @@ TEST_CASE( "dos_to_from_unix" )
     REQUIRE( util::timestamp( unix_tmp ) > time_2 );
 }
 
+TEST_CASE( "line_ending_kernels" )
+{
+    // Reference implementations.
+    auto ref_d2u = []( string const& s ) {
+        string res;
+        for( char c : s ) if( c != '\r' ) res += c;
+        return res;
+    };
+    auto ref_u2d = []( string const& s, char prev ) {
+        string res;
+        for( char c : s ) {
+            if( c == '\n' && prev != '\r' ) res += '\r';
+            res += c;
+            prev = c;
+        }
+        return res;
+    };
+
+    // Mostly CRs and LFs, at all lengths around the vector widths,
+    // so that pairs land on every position within and across blocks.
+    mt19937 gen( 42 );
+    char const alphabet[] = { 'a', 'b', '\r', '\n' };
+    for( size_t len = 0; len < 200; ++len ) {
+        for( int trial = 0; trial < 5; ++trial ) {
+            string s( len, ' ' );
+            for( auto& c : s ) c = alphabet[gen() % 4];
+            INFO( "len: " << len );
+
+            string out( len, 'x' );
+            out.resize( util::dos2unix_span( s, out.data() ) );
+            REQUIRE( out == ref_d2u( s ) );
+
+            string in_place = s;
+            in_place.resize( util::dos2unix_span( in_place,
+                                                  in_place.data() ) );
+            REQUIRE( in_place == ref_d2u( s ) );
+
+            for( char prev : { char( 0 ), '\r', '\n' } ) {
+                auto goal = ref_u2d( s, prev );
+                REQUIRE( util::unix2dos_size( s, prev ) == goal.size() );
+                string out2( goal.size(), 'x' );
+                REQUIRE( util::unix2dos_span( s, out2.data(), prev ) ==
+                         goal.size() );
+                REQUIRE( out2 == goal );
+            }
+
+            // Splitting the input anywhere gives the same result
+            // when the previous char is carried across.
+            size_t cut = len ? gen() % len : 0;
+            string_view first = string_view( s ).substr( 0, cut );
+            string_view second = string_view( s ).substr( cut );
+            char prev = cut ? s[cut-1] : 0;
+            REQUIRE( util::unix2dos_size( first ) +
+                     util::unix2dos_size( second, prev ) ==
+                     ref_u2d( s, 0 ).size() );
+
+            // Containers.
+            string str = s;
+            util::unix2dos( str );
+            REQUIRE( str == ref_u2d( s, 0 ) );
+            util::dos2unix( str );
+            REQUIRE( str == ref_d2u( s ) );
+            deque<char> dq( s.begin(), s.end() );
+            util::unix2dos( dq );
+            REQUIRE( string( dq.begin(), dq.end() ) == ref_u2d( s, 0 ) );
+            util::dos2unix( dq );
+            REQUIRE( string( dq.begin(), dq.end() ) == ref_d2u( s ) );
+        }
+    }
+}
+
+TEST_CASE( "line_endings_files" )
+{
+    auto folder = fs::temp_directory_path()/"line-endings-files";
+    fs::remove_all( folder );
+    fs::create_directories( folder );
+
+    // Larger than the 1 MiB block size used for streaming, with a
+    // CRLF pair straddling each of the first few block boundaries.
+    size_t const mib = 1 << 20;
+    string dos;
+    while( dos.size() < 3*mib + 100 )
+        dos += "some text on a line\r\n";
+    for( size_t k = 1; k <= 3; ++k ) {
+        dos[k*mib-1] = '\r';
+        dos[k*mib]   = '\n';
+    }
+    string unix = dos;
+    util::dos2unix( unix );
+    string dos_again = unix;
+    util::unix2dos( dos_again );
+
+    auto write = [&]( fs::path const& p, string const& s ) {
+        util::write_file( p, vector<char>( s.begin(), s.end() ) );
+    };
+    auto read = [&]( fs::path const& p ) {
+        auto v = util::read_file( p );
+        return string( v.begin(), v.end() );
+    };
+
+    auto f = folder/"big.txt";
+    write( f, dos );
+    fs::permissions( f, fs::perms::owner_read | fs::perms::owner_write |
+                        fs::perms::group_read );
+    REQUIRE( util::dos2unix( f ) == true );
+    REQUIRE( read( f ) == unix );
+    REQUIRE( util::unix2dos( f ) == true );
+    REQUIRE( read( f ) == dos_again );
+    // Permissions are preserved, and no temporary files are left.
+    REQUIRE( fs::status( f ).permissions() ==
+             ( fs::perms::owner_read | fs::perms::owner_write |
+               fs::perms::group_read ) );
+    REQUIRE( distance( fs::directory_iterator( folder ),
+                       fs::directory_iterator() ) == 1 );
+
+    // A clean file is not rewritten at all.
+    REQUIRE( util::unix2dos( f ) == false );
+    auto t0 = util::timestamp( f );
+    util::dos2unix( f );
+    util::timestamp( f, t0 );
+    REQUIRE( util::dos2unix( f ) == false );
+    REQUIRE( util::timestamp( f ) == t0 );
+
+    // Empty files.
+    auto empty = folder/"empty.txt";
+    write( empty, "" );
+    REQUIRE( util::dos2unix( empty ) == false );
+    REQUIRE( util::unix2dos( empty ) == false );
+
+    REQUIRE_THROWS( util::dos2unix( folder/"missing.txt" ) );
+
+#ifdef __linux__
+    // Converting through a symlink converts the target.
+    auto target = folder/"target.txt";
+    auto link   = folder/"link.txt";
+    write( target, "a\r\nb\r\n" );
+    fs::create_symlink( target, link );
+    REQUIRE( util::dos2unix( link ) == true );
+    REQUIRE( fs::is_symlink( link ) );
+    REQUIRE( read( target ) == "a\nb\n" );
+#endif
+
+    fs::remove_all( folder );
+}
+
+TEST_CASE( "line_endings_batch" )
+{
+    auto folder = fs::temp_directory_path()/"line-endings-batch";
+    fs::remove_all( folder );
+    fs::create_directories( folder/"sub"/"deeper" );
+
+    auto write = [&]( fs::path const& p, string const& s ) {
+        util::write_file( p, vector<char>( s.begin(), s.end() ) );
+    };
+    auto read = [&]( fs::path const& p ) {
+        auto v = util::read_file( p );
+        return string( v.begin(), v.end() );
+    };
+
+    write( folder/"a.txt",               "a\r\nb\r\n" );
+    write( folder/"b.txt",               "a\nb\n" );
+    write( folder/"c.cpp",               "a\r\n" );
+    write( folder/"sub"/"d.txt",         "x\r\n" );
+    write( folder/"sub"/"deeper"/"e.txt", "y\r\n" );
+
+    // List of paths.
+    PathVec paths{ folder/"a.txt", folder/"b.txt", folder/"missing.txt",
+                   folder/"c.cpp" };
+    auto t0 = util::timestamp( folder/"a.txt" );
+    this_thread::sleep_for( chrono::milliseconds( 10 ) );
+    auto res = util::dos2unix( paths, /*keepdate=*/true, 2 );
+    REQUIRE( res.size() == 4 );
+    REQUIRE( res[0] == util::Result<bool>( true ) );
+    REQUIRE( res[1] == util::Result<bool>( false ) );
+    REQUIRE( holds_alternative<util::Error>( res[2] ) );
+    REQUIRE( res[3] == util::Result<bool>( true ) );
+    REQUIRE( read( folder/"a.txt" ) == "a\nb\n" );
+    REQUIRE( read( folder/"c.cpp" ) == "a\n" );
+    REQUIRE( util::timestamp( folder/"a.txt" ) == t0 );
+
+    REQUIRE( util::unix2dos( PathVec{} ).empty() );
+
+    // Root plus glob: only *.txt files, at any depth.
+    auto tree = util::unix2dos_tree( folder, "*.txt" );
+    REQUIRE( tree.size() == 4 );
+    REQUIRE( tree[0].first == folder/"a.txt" );
+    REQUIRE( tree[1].first == folder/"b.txt" );
+    REQUIRE( tree[2].first == folder/"sub"/"d.txt" );
+    REQUIRE( tree[3].first == folder/"sub"/"deeper"/"e.txt" );
+    REQUIRE( tree[0].second == util::Result<bool>( true ) );
+    REQUIRE( tree[1].second == util::Result<bool>( true ) );
+    REQUIRE( tree[2].second == util::Result<bool>( false ) );
+    REQUIRE( tree[3].second == util::Result<bool>( false ) );
+    REQUIRE( read( folder/"c.cpp" ) == "a\n" );
+
+    tree = util::dos2unix_tree( folder, "?.txt", false, 1 );
+    REQUIRE( tree.size() == 4 );
+    REQUIRE( read( folder/"sub"/"deeper"/"e.txt" ) == "y\n" );
+    REQUIRE( util::dos2unix_tree( folder, "*.hpp" ).empty() );
+
+    REQUIRE_THROWS( util::dos2unix_tree( folder/"missing", "*" ) );
+
+    fs::remove_all( folder );
+}
+
 TEST_CASE( "touch" )
 {
     auto p = fs::temp_directory_path();
@@ -290,6 +703,145 @@ TEST_CASE( "read_write_file" )
     REQUIRE( fs::file_size( copy ) == 21 );
 }
 
+TEST_CASE( "mapped_file" )
+{
+    auto f = data_common / "3-lines.txt";
+
+    util::MappedFile m( f );
+    REQUIRE( m.size() == 21 );
+    REQUIRE( m.is_mapped() );
+    REQUIRE( m.view() == "line 1\nline 2\nline 3\n" );
+    REQUIRE( m.span().size() == 21 );
+    REQUIRE( util::read_file_as_string( m ) == "line 1\nline 2\nline 3" );
+    REQUIRE( util::read_file_lines( m ) ==
+             (StrVec{ "line 1", "line 2", "line 3" }) );
+
+    // Same contents as read_file.
+    util::MappedFile bin( data_common/"random.bin" );
+    auto v = util::read_file( data_common/"random.bin" );
+    REQUIRE( vector<char>( bin.begin(), bin.end() ) == v );
+
+    // Moving transfers the mapping.
+    util::MappedFile m2 = std::move( m );
+    REQUIRE( m2.size() == 21 );
+    REQUIRE( m.empty() );
+    m = std::move( m2 );
+    REQUIRE( m.view().substr( 0, 6 ) == "line 1" );
+
+    // Empty files are not mapped.
+    auto empty = fs::temp_directory_path()/"empty-mapped.txt";
+    util::write_file( empty, vector<char>{} );
+    util::MappedFile me( empty );
+    REQUIRE( me.empty() );
+    REQUIRE( !me.is_mapped() );
+    REQUIRE( me.view() == "" );
+    REQUIRE( util::read_file_lines( me ).empty() );
+    REQUIRE( util::read_file_as_string( empty ) == "" );
+
+    // Missing files and folders.
+    auto missing = fs::temp_directory_path()/"missing-mapped.txt";
+    util::remove_if_exists( missing );
+    REQUIRE_THROWS( util::MappedFile( missing ) );
+    REQUIRE( !util::MappedFile::open( missing ) );
+    REQUIRE( !util::MappedFile::open( fs::temp_directory_path() ) );
+    REQUIRE( util::read_file_as_string( missing ) == nullopt );
+
+#ifdef __linux__
+    // Special files that report a size of zero are read instead.
+    util::MappedFile proc( "/proc/self/status" );
+    REQUIRE( !proc.is_mapped() );
+    REQUIRE( proc.view().starts_with( "Name:" ) );
+#endif
+
+    // Line endings.
+    util::MappedFile win( data_common/"lines-win.txt" );
+    util::MappedFile unix( data_common/"lines-unix.txt" );
+    auto win_v  = util::read_file( data_common/"lines-win.txt" );
+    auto unix_v = util::read_file( data_common/"lines-unix.txt" );
+    REQUIRE( util::dos2unix( win ) == unix_v );
+    REQUIRE( util::dos2unix( unix ) == unix_v );
+    REQUIRE( util::unix2dos( unix ) == win_v );
+    REQUIRE( util::unix2dos( win ) == win_v );
+
+    // Lines spanning the file's lines and a final line without a
+    // newline.
+    auto partial = fs::temp_directory_path()/"partial-mapped.txt";
+    util::write_file( partial, vector<char>{ 'a', '\n', '\n', 'b' } );
+    util::MappedFile mp( partial );
+    REQUIRE( util::read_file_lines( mp ) == (StrVec{ "a", "", "b" }) );
+    REQUIRE( util::read_file_as_string( mp ) == "a\n\nb" );
+    REQUIRE( util::read_file_lines( partial ) ==
+             (StrVec{ "a", "", "b" }) );
+
+    // Copying a file onto itself leaves it intact.
+    util::copy_file( partial, partial );
+    REQUIRE( fs::file_size( partial ) == 4 );
+}
+
+TEST_CASE( "line_reader" )
+{
+    auto read_all = []( auto&& reader ) {
+        StrVec res;
+        for( string_view line : reader )
+            res.emplace_back( line );
+        return res;
+    };
+
+    auto expected = util::read_file_lines( data_common/"lines-unix.txt" );
+    REQUIRE( expected.size() == 11 );
+
+    // Small block sizes force lines (and CRLF pairs) to span blocks.
+    for( size_t block : { 1, 2, 3, 5, 8, 64, 1024 } ) {
+        INFO( "block size " << block );
+        REQUIRE( read_all( util::LineReader(
+                     data_common/"lines-unix.txt", block ) ) == expected );
+        REQUIRE( read_all( util::LineReader(
+                     data_common/"lines-win.txt", block ) ) == expected );
+    }
+    REQUIRE( read_all( util::LineReader( data_common/"3-lines.txt" ) ) ==
+             (StrVec{ "line 1", "line 2", "line 3" }) );
+
+    auto tmp = fs::temp_directory_path()/"line-reader.txt";
+    auto check = [&]( string const& contents, StrVec const& lines ) {
+        util::write_file( tmp, vector<char>( contents.begin(),
+                                             contents.end() ) );
+        for( size_t block : { 1, 2, 4, 100 } )
+            REQUIRE( read_all( util::LineReader( tmp, block ) ) == lines );
+    };
+    check( "",              {} );
+    check( "\n",            { "" } );
+    check( "\n\n",          { "", "" } );
+    check( "abc",           { "abc" } );
+    check( "abc\ndef",      { "abc", "def" } );
+    check( "a\r\n\r\nb\r\n", { "a", "", "b" } );
+    check( "a\rb\r\r\n\r",   { "a\rb\r", "\r" } );
+
+    // next() can be used directly, and views point into the buffer.
+    util::LineReader r( data_common/"3-lines.txt" );
+    REQUIRE( r.next() == "line 1" );
+    REQUIRE( r.next() == "line 2" );
+    REQUIRE( r.next() == "line 3" );
+    REQUIRE( r.next() == nullopt );
+    REQUIRE( r.next() == nullopt );
+
+    auto missing = fs::temp_directory_path()/"missing-line-reader.txt";
+    util::remove_if_exists( missing );
+    REQUIRE_THROWS( util::LineReader( missing ) );
+
+#ifndef _WIN32
+    // From a pipe.
+    int fds[2];
+    REQUIRE( ::pipe( fds ) == 0 );
+    string data = "x\r\nyy\nzzz";
+    REQUIRE( ::write( fds[1], data.data(), data.size() ) ==
+             ssize_t( data.size() ) );
+    ::close( fds[1] );
+    REQUIRE( read_all( util::LineReader( fds[0], 2 ) ) ==
+             (StrVec{ "x", "yy", "zzz" }) );
+    ::close( fds[0] );
+#endif
+}
+
 TEST_CASE( "rename" )
 {
     auto f1 = fs::temp_directory_path()/"abcdefg";
@@ -402,6 +954,164 @@ TEST_CASE( "lexically_normal" )
     REQUIRE( f( "aa/bb/cc/./../x/y" ) == "aa/bb/x/y" );
 }
 
+TEST_CASE( "lexically_into" )
+{
+    string out;
+    REQUIRE( util::lexically_normal_into( "a//b/./../c/", out ) == "a/c" );
+    REQUIRE( util::lexically_normal_into( "", out ) == "." );
+    REQUIRE( util::lexically_normal_into( "///a/..", out ) == "/" );
+    REQUIRE( util::lexically_normal_into( "//", out ) == "//" );
+    REQUIRE( util::lexically_normal( "////" ) == "////" );
+    REQUIRE( util::lexically_normal_into( "../x/../../y", out ) == "../../y" );
+    REQUIRE( out == "../../y" );
+    REQUIRE( util::lexically_relative_into( "/a/b/x", "/a/b/c/d", out ) ==
+             "../../x" );
+    REQUIRE( util::lexically_relative_into( "a", "/a", out ) == "" );
+    REQUIRE( util::lexically_relative_into( ".", "../a", out ) == "" );
+    REQUIRE( util::lexically_relative_into( "a/./b", "a//b/", out ) == "." );
+
+#ifndef _WIN32
+    // Compare against the standard library's normalization,  which
+    // differs only in that it keeps a trailing slash (except  on  a
+    // path of only slashes, which both leave as it is).
+    mt19937 gen( 2 );
+    array<string_view, 6> parts{ "a", "bb", ".", "..", "", "c" };
+    vector<string> paths{ "/", "//", "///", "////" };
+    for( int i = 0; i < 2000; ++i ) {
+        string p = ( gen() % 2 ) ? "/" : "";
+        int n = gen() % 8;
+        for( int j = 0; j < n; ++j ) {
+            if( j > 0 ) p += '/';
+            p += parts[gen() % parts.size()];
+        }
+        paths.push_back( p );
+    }
+    for( auto const& p : paths ) {
+        string expected = fs::path( p ).lexically_normal().string();
+        bool slashes_only = !p.empty() &&
+            p.find_first_not_of( '/' ) == string::npos;
+        if( !slashes_only && expected.size() > 1 &&
+            expected.back() == '/' )
+            expected.pop_back();
+        if( expected.empty() )
+            expected = ".";
+        INFO( "path: " << p );
+        REQUIRE( util::lexically_normal_into( p, out ) == expected );
+        REQUIRE( util::lexically_normal( p ) == expected );
+    }
+#endif
+}
+
+TEST_CASE( "path_table" )
+{
+    util::PathTable t;
+    auto dot = util::PathTable::dot;
+
+    REQUIRE( t.intern( "" ) == dot );
+    REQUIRE( t.intern( "." ) == dot );
+    REQUIRE( t.to_path( dot ) == "." );
+
+    auto abc = t.intern( A( "/a/b/c" ) );
+    auto ab  = t.intern( A( "/a/b" ) );
+    REQUIRE( t.intern( A( "/a//b/./c/" ) ) == abc );
+    REQUIRE( t.intern( A( "/a/b/x/../c" ) ) == abc );
+    REQUIRE( t.to_path( abc ) == A( "/a/b/c" ) );
+    REQUIRE( t.parent( abc ) == ab );
+    REQUIRE( t.filename( abc ) == "c" );
+    REQUIRE( t.is_absolute( abc ) );
+    REQUIRE( t.starts_with( abc, ab ) );
+    REQUIRE( t.starts_with( abc, abc ) );
+    REQUIRE( !t.starts_with( ab, abc ) );
+    REQUIRE( !t.starts_with( abc, t.intern( A( "/a/c" ) ) ) );
+    REQUIRE( !t.starts_with( abc, dot ) );
+
+    auto root = t.intern( A( "/" ) );
+    REQUIRE( t.starts_with( abc, root ) );
+    REQUIRE( t.parent( root ) == root );
+    REQUIRE( t.ancestor( abc, t.depth( root ) ) == root );
+    REQUIRE( t.ancestor( abc, t.depth( abc ) ) == abc );
+    REQUIRE( t.ancestor( abc, 0 ) == dot );
+
+    auto rel = t.intern( "x/y" );
+    REQUIRE( t.depth( rel ) == 2 );
+    REQUIRE( !t.is_absolute( rel ) );
+    REQUIRE( t.parent( t.parent( rel ) ) == dot );
+    REQUIRE( t.parent( dot ) == dot );
+    REQUIRE( t.starts_with( rel, dot ) );
+    REQUIRE( t.child( t.intern( "x" ), "y" ) == rel );
+    REQUIRE( t.to_path( t.child( rel, "z" ) ) == "x/y/z" );
+    REQUIRE_THROWS( t.child( rel, ".." ) );
+    REQUIRE_THROWS( t.child( rel, "a/b" ) );
+    REQUIRE_THROWS( t.to_path( util::PathId( 1000000 ) ) );
+
+    // Prefixes are shared.
+    auto before = t.size();
+    t.intern( "x/y/w" );
+    REQUIRE( t.size() == before+1 );
+    REQUIRE( t.find( "x/y/w" ) == t.intern( "x/y/w" ) );
+    REQUIRE( t.find( "x/q" ) == nullopt );
+    REQUIRE( t.find( "never/seen" ) == nullopt );
+
+    // Case.
+    auto upper = t.intern( "X/Y" );
+    REQUIRE( upper != rel );
+    REQUIRE( util::path_equals( t, upper, rel, util::CaseSensitive::NO ) );
+    REQUIRE( !util::path_equals( t, upper, rel, util::CaseSensitive::YES ) );
+    REQUIRE( util::path_equals( t, rel, rel, util::CaseSensitive::YES ) );
+    REQUIRE( t.folded( upper ) == rel );
+    REQUIRE( t.folded( rel ) == rel );
+    REQUIRE( util::path_equals( t, upper, rel ) ==
+             util::path_equals( "X/Y", "x/y" ) );
+
+    // Folded forms are not visible unless they are interned.
+    {
+        util::PathTable t2;
+        // The root takes a different number of nodes on Windows.
+        t2.intern( A( "/" ) );
+        auto paths = t2.size(), comps = t2.num_components();
+        auto foo_bar = t2.intern( A( "/Foo/Bar" ) );
+        REQUIRE_FALSE( t2.find( A( "/foo/bar" ) ) );
+        REQUIRE_FALSE( t2.find( A( "/foo" ) ) );
+        REQUIRE( t2.find( A( "/Foo" ) ) );
+        REQUIRE( t2.size() == paths+2 );
+        REQUIRE( t2.num_components() == comps+2 );
+        auto folded = t2.folded( foo_bar );
+        REQUIRE( t2.intern( A( "/foo/bar" ) ) == folded );
+        REQUIRE( t2.find( A( "/foo/bar" ) ) == folded );
+        REQUIRE( t2.find( A( "/foo" ) ) );
+        REQUIRE( t2.size() == paths+4 );
+        REQUIRE( t2.num_components() == comps+4 );
+    }
+
+    // lexically_relative should agree with the fs::path version.
+    mt19937 gen( 3 );
+    array<char const*, 5> parts{ "a", "b", "..", ".", "C" };
+    auto rand_path = [&]( bool abs ) {
+        string p = abs ? A( "/" ) : "";
+        int n = gen() % 5;
+        for( int j = 0; j < n; ++j ) {
+            if( j > 0 ) p += '/';
+            p += parts[gen() % parts.size()];
+        }
+        return p;
+    };
+    for( int i = 0; i < 2000; ++i ) {
+        bool abs = ( gen() % 2 );
+        auto p = rand_path( abs );
+        auto b = rand_path( ( gen() % 8 == 0 ) ? !abs : abs );
+        INFO( "p: " << p << ", base: " << b );
+        auto expected = util::lexically_relative( p, b );
+        auto res = util::lexically_relative( t, t.intern( p ),
+                                             t.intern( b ) );
+        if( expected.empty() ) {
+            REQUIRE( res == nullopt );
+        } else {
+            REQUIRE( res != nullopt );
+            REQUIRE( t.to_path( *res ) == expected );
+        }
+    }
+}
+
 TEST_CASE( "lexically_absolute" )
 {
     auto f = util::lexically_absolute;
@@ -439,7 +1149,9 @@ TEST_CASE( "lexically_absolute" )
 
 TEST_CASE( "lexically_relative" )
 {
-    auto f = util::lexically_relative;
+    // There is also an overload taking PathTable handles.
+    fs::path (*f)( fs::path const&, fs::path const& ) =
+        util::lexically_relative;
 
     // Relative paths.
     REQUIRE( f( "", "" ) == "." );
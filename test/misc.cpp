@@ -10,7 +10,10 @@
 #include "base-util/string.hpp"
 #include "base-util/type-map.hpp"
 
+#include <cstdlib>
+#include <ctime>
 #include <optional>
+#include <random>
 #include <type_traits>
 
 using namespace std;
@@ -66,6 +69,246 @@ TEST_CASE( "datetime" )
     REQUIRE( hhmm.size() == 5 );
     auto hhmm_utc = util::tz_hhmm( util::tz_utc() );
     REQUIRE( hhmm_utc == "+0000" );
+
+    using namespace std::chrono;
+    using util::fmt_time;
+    REQUIRE( fmt_time( seconds( 0 ) ) == "1970-01-01 00:00:00" );
+    REQUIRE( fmt_time( seconds( 951782400 ) ) == "2000-02-29 00:00:00" );
+    REQUIRE( fmt_time( seconds( -1 ) ) == "1969-12-31 23:59:59" );
+    REQUIRE( fmt_time( seconds( 253402300799 ) ) ==
+             "9999-12-31 23:59:59" );
+    REQUIRE( fmt_time( seconds( -62167219200 ) ) ==
+             "0000-01-01 00:00:00" );
+    REQUIRE_THROWS( fmt_time( seconds( 253402300800 ) ) );
+    REQUIRE_THROWS( fmt_time( seconds( -62167219201 ) ) );
+
+    // Compare against the C library on random times from year 1000
+    // (before which strftime does not pad the year) through 9999.
+    mt19937_64 gen( 2024 );
+    uniform_int_distribution<int64_t> dist( -30610224000,
+                                            253402300799 );
+    for( int i = 0; i < 2000; ++i ) {
+        time_t t = time_t( dist( gen ) );
+        tm cal{};
+        gmtime_r( &t, &cal );
+        char expect[32];
+        strftime( expect, sizeof( expect ), "%Y-%m-%d %H:%M:%S", &cal );
+        REQUIRE( fmt_time( seconds( t ) ) == expect );
+    }
+
+    // Nanoseconds, including within the same second (which is when
+    // the cached date/time is reused) and before the epoch.
+    auto base = system_clock::time_point( seconds( 1516053168 ) );
+    char buf[util::fmt_time_length];
+    util::fmt_time_into( buf, base + nanoseconds( 421397398 ) );
+    REQUIRE( string_view( buf, sizeof( buf ) ) ==
+             "2018-01-15 21:52:48.421397398" );
+    util::fmt_time_into( buf, base + nanoseconds( 5 ) );
+    REQUIRE( string_view( buf, sizeof( buf ) ) ==
+             "2018-01-15 21:52:48.000000005" );
+    util::fmt_time_into( buf, base + nanoseconds( 999999999 ) );
+    REQUIRE( string_view( buf, sizeof( buf ) ) ==
+             "2018-01-15 21:52:48.999999999" );
+    util::fmt_time_into( buf, base + seconds( 1 ) );
+    REQUIRE( string_view( buf, sizeof( buf ) ) ==
+             "2018-01-15 21:52:49.000000000" );
+    REQUIRE( fmt_time( system_clock::time_point( -nanoseconds( 1 ) ) )
+             == "1969-12-31 23:59:59.999999999" );
+
+    // A failed format must not leave behind a stale cached second.
+    REQUIRE( fmt_time( base ) == "2018-01-15 21:52:48.000000000" );
+    REQUIRE_THROWS( fmt_time( seconds( 253402300800 ) ) );
+    REQUIRE( fmt_time( base ) == "2018-01-15 21:52:48.000000000" );
+
+    auto zbase = ZonedTimePoint( base, util::tz_utc() );
+    REQUIRE( fmt_time( zbase, util::tz_utc() ) ==
+             "2018-01-15 21:52:48.000000000+0000" );
+    REQUIRE( util::to_string( zbase ) ==
+             "2018-01-15 21:52:48.000000000+0000" );
+    REQUIRE( fmt_time( zbase, hours( -5 ) ) ==
+             "2018-01-15 16:52:48.000000000-0500" );
+}
+
+#ifndef _WIN32
+TEST_CASE( "tz_local" )
+{
+    using namespace std::chrono;
+
+    // Agrees with the C library right now.
+    time_t now = time( nullptr );
+    tm local{};
+    localtime_r( &now, &local );
+    REQUIRE( util::tz_local() == seconds( local.tm_gmtoff ) );
+    REQUIRE( util::tz_local() == util::tz_local() );
+
+    auto window = util::detail::tz_local_window( seconds( now ) );
+    REQUIRE( window.offset == seconds( local.tm_gmtoff ) );
+    REQUIRE( window.valid_until > seconds( now ) );
+    REQUIRE( window.valid_until <= seconds( now ) + hours( 24 ) );
+
+    // Use a time zone with daylight savings time (given by  rule
+    // so that it does not depend on the time zone database) to
+    // check that the window ends exactly at the transitions.
+    char const* old_tz = getenv( "TZ" );
+    optional<string> saved;
+    if( old_tz ) saved = old_tz;
+    // No call to tzset here: tz_local_window must notice the change
+    // itself.
+    setenv( "TZ", "EST5EDT,M3.2.0,M11.1.0", 1 );
+
+    // 2021-03-14 07:00:00 UTC is 2am EST, when EDT starts.
+    constexpr int64_t spring = 1615705200;
+    window = util::detail::tz_local_window( seconds( spring-5*3600 ) );
+    REQUIRE( window.offset == hours( -5 ) );
+    REQUIRE( window.valid_until == seconds( spring ) );
+    window = util::detail::tz_local_window( seconds( spring-1 ) );
+    REQUIRE( window.offset == hours( -5 ) );
+    REQUIRE( window.valid_until == seconds( spring ) );
+    window = util::detail::tz_local_window( seconds( spring ) );
+    REQUIRE( window.offset == hours( -4 ) );
+    REQUIRE( window.valid_until == seconds( spring ) + hours( 24 ) );
+
+    // 2021-11-07 06:00:00 UTC is 2am EDT, when EST returns.
+    constexpr int64_t fall = 1636264800;
+    window = util::detail::tz_local_window( seconds( fall-100 ) );
+    REQUIRE( window.offset == hours( -4 ) );
+    REQUIRE( window.valid_until == seconds( fall ) );
+
+    if( saved )
+        setenv( "TZ", saved->c_str(), 1 );
+    else
+        unsetenv( "TZ" );
+    tzset();
+}
+#endif
+
+TEST_CASE( "parse_time" )
+{
+    using namespace std::chrono;
+    using util::fmt_time;
+    using util::parse_time;
+    using util::parse_tz_hhmm;
+
+    REQUIRE( parse_time<seconds>( "1970-01-01 00:00:00" ) == seconds( 0 ) );
+    REQUIRE( parse_time<seconds>( "2000-02-29 00:00:00" ) ==
+             seconds( 951782400 ) );
+    REQUIRE( parse_time<seconds>( "1969-12-31 23:59:59" ) == seconds( -1 ) );
+    REQUIRE( parse_time<seconds>( "9999-12-31 23:59:59" ) ==
+             seconds( 253402300799 ) );
+    REQUIRE( parse_time<seconds>( "0000-01-01 00:00:00" ) ==
+             seconds( -62167219200 ) );
+
+    // Malformed or out of range.
+    for( string_view bad : {
+            "", "1970-01-01 00:00:0", "1970-01-01 00:00:000",
+            " 1970-01-01 00:00:00", "1970-01-01T00:00:00",
+            "1970/01/01 00:00:00", "197a-01-01 00:00:00",
+            "1970-01-01 00:00:0a", "1970-00-01 00:00:00",
+            "1970-13-01 00:00:00", "1970-01-00 00:00:00",
+            "1970-01-32 00:00:00", "1970-04-31 00:00:00",
+            "1900-02-29 00:00:00", "2001-02-29 00:00:00",
+            "1970-01-01 24:00:00", "1970-01-01 00:60:00",
+            "1970-01-01 00:00:60" } )
+        REQUIRE_FALSE( parse_time<seconds>( bad ).has_value() );
+    REQUIRE( parse_time<seconds>( "2004-02-29 00:00:00" ).has_value() );
+
+    auto base = system_clock::time_point( seconds( 1516053168 ) );
+    REQUIRE( parse_time<SysTimePoint>( "2018-01-15 21:52:48.421397398" ) ==
+             base + nanoseconds( 421397398 ) );
+    REQUIRE( parse_time<SysTimePoint>( "2018-01-15 21:52:48.000000001" ) ==
+             base + nanoseconds( 1 ) );
+    REQUIRE_FALSE( parse_time<SysTimePoint>( "2018-01-15 21:52:48" ) );
+    REQUIRE_FALSE( parse_time<SysTimePoint>(
+        "2018-01-15 21:52:48,421397398" ) );
+    REQUIRE_FALSE( parse_time<SysTimePoint>(
+        "2018-01-15 21:52:48.42139739x" ) );
+    REQUIRE_FALSE( parse_time<SysTimePoint>(
+        "2018-01-15 21:52:48.x21397398" ) );
+    // Does not fit in a nanosecond time point.
+    REQUIRE_FALSE( parse_time<SysTimePoint>(
+        "9999-01-15 21:52:48.000000000" ) );
+
+    REQUIRE( parse_tz_hhmm( "+0000" ) == util::tz_utc() );
+    REQUIRE( parse_tz_hhmm( "-0500" ) == hours( -5 ) );
+    REQUIRE( parse_tz_hhmm( "+0530" ) == hours( 5 ) + minutes( 30 ) );
+    REQUIRE( parse_tz_hhmm( util::tz_hhmm() ) == util::tz_local() );
+    for( string_view bad : { "", "0000", "+000", "+00000", "*0000",
+                             "+2400", "+0060", "+00a0" } )
+        REQUIRE_FALSE( parse_tz_hhmm( bad ).has_value() );
+
+    auto z = parse_time<ZonedTimePoint>(
+        "2018-01-15 16:52:48.421397398-0500" );
+    REQUIRE( z.has_value() );
+    REQUIRE( z->to_local( util::tz_utc() ) ==
+             base + nanoseconds( 421397398 ) );
+    REQUIRE_FALSE( parse_time<ZonedTimePoint>(
+        "2018-01-15 16:52:48.421397398" ).has_value() );
+    REQUIRE_FALSE( parse_time<ZonedTimePoint>(
+        "2018-01-15 16:52:48.421397398 0500" ).has_value() );
+    // Near the ends of the range of a nanosecond time point the
+    // offset can take the result out of range.
+    REQUIRE( parse_time<ZonedTimePoint>(
+        "2262-04-11 23:47:15.000000000+0000" ).has_value() );
+    REQUIRE_FALSE( parse_time<ZonedTimePoint>(
+        "2262-04-11 23:47:15.000000000-2359" ).has_value() );
+    REQUIRE( parse_time<ZonedTimePoint>(
+        "1677-09-21 00:12:45.000000000+0000" ).has_value() );
+    REQUIRE_FALSE( parse_time<ZonedTimePoint>(
+        "1677-09-21 00:12:45.000000000+2359" ).has_value() );
+
+    // Round trips through fmt_time.
+    mt19937_64 gen( 11 );
+    uniform_int_distribution<int64_t> secs( -5000000000, 7000000000 );
+    uniform_int_distribution<int64_t> nanos( 0, 999999999 );
+    uniform_int_distribution<int>     off_mins( -23*60, 23*60 );
+    for( int i = 0; i < 2000; ++i ) {
+        auto s = seconds( secs( gen ) );
+        REQUIRE( parse_time<seconds>( fmt_time( s ) ) == s );
+        auto p = SysTimePoint( s + nanoseconds( nanos( gen ) ) );
+        REQUIRE( parse_time<SysTimePoint>( fmt_time( p ) ) == p );
+        auto off = duration_cast<seconds>( minutes( off_mins( gen ) ) );
+        auto zp  = ZonedTimePoint( p, util::tz_utc() );
+        auto zparsed = parse_time<ZonedTimePoint>( fmt_time( zp, off ) );
+        REQUIRE( zparsed.has_value() );
+        REQUIRE( zparsed->to_local( util::tz_utc() ) == p );
+    }
+
+    // Columns, with runs on the same day and a few bad entries.
+    vector<string>      stamps;
+    vector<SysTimePoint> expect;
+    auto t = base;
+    for( int i = 0; i < 500; ++i ) {
+        t += nanoseconds( nanos( gen ) ) * 300;
+        expect.push_back( t );
+        stamps.push_back( fmt_time( t ) );
+    }
+    stamps[7] = "2018-02-30 00:00:00.000000000";
+    stamps[8] = "garbage";
+    vector<string_view> views( stamps.begin(), stamps.end() );
+    vector<optional<SysTimePoint>> parsed( views.size() );
+    REQUIRE( util::parse_times( views, parsed ) == views.size()-2 );
+    for( size_t i = 0; i < views.size(); ++i ) {
+        if( i == 7 || i == 8 )
+            REQUIRE_FALSE( parsed[i].has_value() );
+        else
+            REQUIRE( parsed[i] == expect[i] );
+    }
+
+    vector<string> zstamps{ "2018-01-15 16:52:48.421397398-0500",
+                            "2018-01-15 16:52:49.000000000-0500",
+                            "2018-01-15 21:52:49.000000000+0000",
+                            "2018-01-15 21:52:49.000000000" };
+    vector<string_view> zviews( zstamps.begin(), zstamps.end() );
+    vector<optional<ZonedTimePoint>> zparsed( zviews.size() );
+    REQUIRE( util::parse_times( zviews, zparsed ) == 3 );
+    REQUIRE( zparsed[1].has_value() );
+    REQUIRE( zparsed[2].has_value() );
+    REQUIRE( zparsed[1]->to_local( util::tz_utc() ) ==
+             zparsed[2]->to_local( util::tz_utc() ) );
+    REQUIRE_FALSE( zparsed[3].has_value() );
+
+    vector<optional<SysTimePoint>> too_small( 1 );
+    REQUIRE_THROWS( util::parse_times( views, too_small ) );
 }
 
 TEST_CASE( "opt_util" )
@@ -10,6 +10,9 @@
 
 #include "catch2/catch.hpp"
 
+#include <cstdio>
+#include <random>
+
 using namespace std;
 
 TEST_CASE( "url_encode" )
@@ -50,4 +53,130 @@ TEST_CASE( "url_encode" )
              "with%20spaces=with%26amp";
 
     REQUIRE( net::url_encode_kv( bm ) == target );
+
+    // Pairs of views, appending to an existing string.
+    vector<pair<string_view, string_view>> kv2{
+        { "q", "a b" }, { "", "" }, { "x/y", "z" } };
+    string out = "http://host/path?";
+    net::url_encode_kv_into( out, kv2 );
+    REQUIRE( out == "http://host/path?q=a%20b&=&x%2Fy=z" );
+
+    REQUIRE( net::url_encode_kv( vector<pair<string, string>>{} ) == "" );
+    REQUIRE( net::url_encode_kv(
+                 vector<tuple<char const*, string>>{ { "k", "v" } } )
+             == "k=v" );
+}
+
+TEST_CASE( "query_parser" )
+{
+    auto parse = []( string_view query ) {
+        vector<pair<string, string>> res;
+        net::QueryParser parser( query );
+        while( auto param = parser.next() )
+            res.emplace_back( param->key, param->value );
+        return res;
+    };
+    using KV = vector<pair<string, string>>;
+
+    REQUIRE( parse( "" ) == KV{} );
+    REQUIRE( parse( "&&" ) == KV{} );
+    REQUIRE( parse( "a=1" ) == (KV{ { "a", "1" } }) );
+    REQUIRE( parse( "a=1&b=2" ) == (KV{ { "a", "1" }, { "b", "2" } }) );
+    REQUIRE( parse( "&a=1&&b&" ) == (KV{ { "a", "1" }, { "b", "" } }) );
+    REQUIRE( parse( "a=&=b" ) == (KV{ { "a", "" }, { "", "b" } }) );
+    REQUIRE( parse( "a=x=y" ) == (KV{ { "a", "x=y" } }) );
+    REQUIRE( parse( "a%20b=c%26d+e" ) == (KV{ { "a b", "c&d+e" } }) );
+    REQUIRE_THROWS( parse( "a=%zz" ) );
+
+    // Views into the query when there is nothing to decode.
+    string query = "key=value&k%41=v%42";
+    net::QueryParser parser( query );
+    auto p1 = parser.next();
+    REQUIRE( p1.has_value() );
+    REQUIRE( p1->key.data() == query.data() );
+    REQUIRE( p1->value.data() == query.data()+4 );
+    auto p2 = parser.next();
+    REQUIRE( p2.has_value() );
+    REQUIRE( p2->key == "kA" );
+    REQUIRE( p2->value == "vB" );
+    REQUIRE_FALSE( parser.next().has_value() );
+
+    // Round trip.
+    vector<tuple<string, string>> kv{
+        { "hello", "world" }, { "a&b", "c=d" }, { "", "%" },
+        { "\xff\x01", "\n" } };
+    auto decoded = parse( net::url_encode_kv( kv ) );
+    REQUIRE( decoded.size() == kv.size() );
+    for( size_t i = 0; i < kv.size(); ++i ) {
+        REQUIRE( decoded[i].first  == get<0>( kv[i] ) );
+        REQUIRE( decoded[i].second == get<1>( kv[i] ) );
+    }
+}
+
+TEST_CASE( "url_encode_decode" )
+{
+    // Simple reference encoder.
+    auto encode = []( string_view in ) {
+        string res;
+        for( char c : in ) {
+            if( ( c >= 'a' && c <= 'z' ) || ( c >= 'A' && c <= 'Z' ) ||
+                ( c >= '0' && c <= '9' ) || c == '-' || c == '_' ||
+                  c == '.' || c == '~' ) {
+                res += c;
+                continue;
+            }
+            char buf[4];
+            snprintf( buf, sizeof( buf ), "%%%02X",
+                      unsigned( (unsigned char)c ) );
+            res += buf;
+        }
+        return res;
+    };
+
+    string all;
+    for( int i = 0; i < 256; ++i )
+        all += char( i );
+    REQUIRE( net::url_encode( all ) == encode( all ) );
+    REQUIRE( net::url_encoded_size( all ) == encode( all ).size() );
+    REQUIRE( net::url_decode( net::url_encode( all ) ) == all );
+
+    REQUIRE( net::url_encode( "" ) == "" );
+    REQUIRE( net::url_encode( "a b" ) == "a%20b" );
+    REQUIRE( net::url_encode( "\xff" ) == "%FF" );
+
+    // Appends.
+    string out = "x=";
+    net::url_encode_into( out, "1 2" );
+    REQUIRE( out == "x=1%202" );
+    REQUIRE( net::url_decode_into( out, "%3d%3D+" ) );
+    REQUIRE( out == "x=1%202==+" );
+
+    REQUIRE( net::url_decode( "" ) == "" );
+    REQUIRE( net::url_decode( "abc" ) == "abc" );
+    REQUIRE( net::url_decode( "%41%4a%4A" ) == "AJJ" );
+    REQUIRE( net::url_decode( "a+b" ) == "a+b" );
+    REQUIRE_FALSE( net::url_decode( "%" ).has_value() );
+    REQUIRE_FALSE( net::url_decode( "%4" ).has_value() );
+    REQUIRE_FALSE( net::url_decode( "abc%4g" ).has_value() );
+    REQUIRE_FALSE( net::url_decode( "%g4abc" ).has_value() );
+    REQUIRE_FALSE( net::url_decode_into( out, "%%" ) );
+    REQUIRE( out == "x=1%202==+" );
+
+    // Random inputs of all lengths around the block sizes, some with
+    // only a few bytes that need escaping.
+    mt19937 gen( 99 );
+    uniform_int_distribution<int> byte( 0, 255 );
+    uniform_int_distribution<int> letter( 'a', 'z' );
+    for( size_t len = 0; len < 200; ++len ) {
+        for( bool sparse : { false, true } ) {
+            string s;
+            for( size_t i = 0; i < len; ++i )
+                s += char( ( sparse && byte( gen ) > 8 ) ? letter( gen )
+                                                         : byte( gen ) );
+            auto enc = net::url_encode( s );
+            REQUIRE( enc == encode( s ) );
+            REQUIRE( net::url_encoded_size( s ) == enc.size() );
+            REQUIRE( net::url_decode( enc ) == s );
+        }
+    }
 }
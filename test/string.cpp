@@ -5,6 +5,9 @@
 
 #include "base-util/string.hpp"
 
+#include <limits>
+#include <random>
+
 using namespace std;
 
 TEST_CASE( "common_prefix" )
@@ -51,6 +54,57 @@ TEST_CASE( "common_prefix" )
     REQUIRE( common_prefix( v ) == "abcd.e" );
     v = {"abcd.efg", "abc", "abcd.efghi"};
     REQUIRE( common_prefix( v ) == "abc" );
+
+    using util::common_prefix_view;
+    REQUIRE_FALSE( common_prefix_view( vector<string_view>{} ) );
+    v = {"abcd.efg", "abc", "abcd.efghi"};
+    auto view = common_prefix_view( v );
+    REQUIRE( view == "abc" );
+    REQUIRE( view->data() == v[0].data() );
+    vector<string_view> svs{ "xyz", "xy", "x" };
+    REQUIRE( common_prefix_view( svs ) == "x" );
+
+    // Long strings, with the difference at each possible  position
+    // relative to the 16 and 32 byte blocks.
+    string base( 100, 'q' );
+    for( size_t i = 0; i < base.size(); ++i ) {
+        v = { base, base, base };
+        v[1][i] = 'r';
+        REQUIRE( common_prefix( v ) == base.substr( 0, i ) );
+        v[1] = base.substr( 0, i );
+        REQUIRE( common_prefix( v ) == base.substr( 0, i ) );
+    }
+
+    // Enough strings to be split up among jobs; compare against
+    // the simple approach of narrowing down the prefix one string
+    // at a time.
+    mt19937 gen( 777 );
+    uniform_int_distribution<int> len( 0, 40 );
+    uniform_int_distribution<int> letter( 'a', 'c' );
+    for( int round = 0; round < 4; ++round ) {
+        string root = "/home/user/some/project/";
+        root.resize( size_t( len( gen ) ) );
+        v.assign( 100000, root );
+        for( auto& s : v ) {
+            // Mostly things that extend the root, but rarely one
+            // that cuts it short.
+            if( len( gen ) == 0 )
+                s.resize( s.size()/2 );
+            else
+                for( int k = len( gen )/8; k > 0; --k )
+                    s += char( letter( gen ) );
+        }
+        string_view expect = v[0];
+        for( auto const& s : v )
+            expect = expect.substr( 0, size_t( mismatch(
+                expect.begin(), expect.end(), s.begin(),
+                s.end() ).first - expect.begin() ) );
+        for( int jobs : { 1, 0, 4 } ) {
+            auto res = common_prefix_view( v, jobs );
+            REQUIRE( res == expect );
+            REQUIRE( res->data() == v[0].data() );
+        }
+    }
 }
 
 TEST_CASE( "split_join" )
@@ -85,6 +139,61 @@ TEST_CASE( "split_join" )
 
     REQUIRE( util::split_strip_any( " ab\n,\nx\ncd   ,ef   ", ",\n" ) ==
             (SVVec{"ab","x","cd","ef"}) );
+
+    // Lazy versions.
+    static_assert( ranges::forward_range<util::SplitView> );
+    static_assert( ranges::view<util::SplitView> );
+    static_assert( ranges::borrowed_range<util::SplitView> );
+
+    auto collect = []( util::SplitView v ) {
+        return SVVec( v.begin(), ranges::next( v.begin(), v.end() ) );
+    };
+    REQUIRE( collect( util::split_view( "", ',' ) ) == (SVVec{ "" }) );
+    REQUIRE( collect( util::split_view( ",", ',' ) ) == (SVVec{ "", "" }) );
+    REQUIRE( collect( util::split_view( "ab,cd,ef", ',' ) ) == svv );
+    REQUIRE( collect( util::split_view( "ab,cd-ef", ",-" ) ) == svv );
+    REQUIRE( collect( util::split_view( "ab,cd", "" ) ) ==
+             (SVVec{ "ab,cd" }) );
+    REQUIRE( collect( util::split_strip_view( " ab ,cd   ,ef   ", ',' ) ) ==
+             (SVVec{ "ab", "cd", "ef" }) );
+    REQUIRE( collect( util::split_strip_view( " , ,\t", ',' ) ) ==
+             (SVVec{}) );
+    REQUIRE( util::split_strip_view( " , ", ',' ).empty() );
+    REQUIRE( util::split_view( "a;b", ';' ).front() == "a" );
+
+    // Pieces come back as views into the original string.
+    string_view csv = "x,\xff\x80,,y";
+    auto it = util::split_view( csv, ",\xff" ).begin();
+    ++it;
+    REQUIRE( *it == "" );
+    REQUIRE( (*it).data() == csv.data() + 2 );
+    REQUIRE( *++it == "\x80" );
+
+    // Agrees with the eager versions on random input.
+    mt19937 gen( 5 );
+    string_view alphabet = "ab ,;\t";
+    for( int i = 0; i < 500; ++i ) {
+        string str;
+        for( size_t j = gen() % 40; j > 0; --j )
+            str += alphabet[gen() % alphabet.size()];
+        SVVec pieces;
+        string_view rest = str;
+        for( auto pos = rest.find_first_of( ",;" ); pos != string::npos;
+                  pos = rest.find_first_of( ",;" ) ) {
+            pieces.push_back( rest.substr( 0, pos ) );
+            rest.remove_prefix( pos+1 );
+        }
+        pieces.push_back( rest );
+        SVVec stripped;
+        for( auto piece : pieces )
+            if( auto p = util::strip( piece ); !p.empty() )
+                stripped.push_back( p );
+        REQUIRE( collect( util::split_view( str, ",;" ) ) == pieces );
+        REQUIRE( util::split_on_any( str, ",;" ) == pieces );
+        REQUIRE( collect( util::split_strip_view( str, ",;" ) ) ==
+                 stripped );
+        REQUIRE( util::split_strip_any( str, ",;" ) == stripped );
+    }
 }
 
 TEST_CASE( "wrap" )
@@ -248,6 +357,92 @@ TEST_CASE( "wrap" )
         //------------------------------------------------------------------------------------------
         {"Ask not what your country can do for you but instead ask what you can do for your country."};
     REQUIRE( util::wrap_text( text1, 90 ) == res90 );
+
+    // The callback version makes the same greedy choices.
+    for( int len = 0; len < 95; ++len ) {
+        auto by_fn = util::wrap_text_fn( text1, [len]( string_view sv ) {
+            return int( sv.size() ) <= len;
+        });
+        REQUIRE( by_fn == util::wrap_text( text1, len ) );
+    }
+
+    // Views point into the input and keep its spacing.
+    string text2 = "aaa bb  cc\nddddd";
+    auto views = util::wrap_text_views( text2, 8 );
+    REQUIRE( views == (vector<string_view>{"aaa bb","cc\nddddd"}) );
+    REQUIRE( views[0].data() == text2.data() );
+    REQUIRE( views[1].data() == text2.data()+8 );
+    REQUIRE( util::wrap_text( text2, 8 ) ==
+             (vector<string>{"aaa bb","cc ddddd"}) );
+    REQUIRE( util::wrap_text_views( "", 6 ).empty() );
+    REQUIRE( util::wrap_text_views( " \n ", 6 ).empty() );
+
+    using util::WrapMode;
+    REQUIRE( util::wrap_text( "aaa bb cc ddddd", 6,
+                              WrapMode::MIN_RAGGED ) ==
+             (vector<string>{"aaa","bb cc","ddddd"}) );
+    REQUIRE( util::wrap_text_views( "aaa bb cc ddddd", 6,
+                                    WrapMode::MIN_RAGGED ) ==
+             (vector<string_view>{"aaa","bb cc","ddddd"}) );
+    // Words that are too long still go on their own lines.
+    REQUIRE( util::wrap_text( "a bbbbbbbb c d", 3,
+                              WrapMode::MIN_RAGGED ) ==
+             (vector<string>{"a","bbbbbbbb","c d"}) );
+    REQUIRE( util::wrap_text( "abc", 0, WrapMode::MIN_RAGGED ) ==
+             vector<string>{"abc"} );
+
+    // Compare MIN_RAGGED against trying every possible set of
+    // breaks on short random texts.
+    auto line_cost = []( vector<string> const& lines, size_t max_len,
+                         bool& valid ) {
+        size_t cost = 0;
+        valid = true;
+        for( size_t l = 0; l < lines.size(); ++l ) {
+            auto const& line = lines[l];
+            bool one_word = line.find( ' ' ) == string::npos;
+            if( line.size() > max_len ) {
+                if( !one_word ) valid = false;
+                continue;
+            }
+            if( l+1 < lines.size() )
+                cost += (max_len-line.size())*(max_len-line.size());
+        }
+        return cost;
+    };
+    mt19937 gen( 4321 );
+    uniform_int_distribution<int> num_words( 1, 10 );
+    uniform_int_distribution<int> word_len( 1, 7 );
+    for( int round = 0; round < 300; ++round ) {
+        vector<string> words( size_t( num_words( gen ) ) );
+        string text;
+        for( auto& w : words ) {
+            w = string( size_t( word_len( gen ) ), 'x' );
+            text += w + ' ';
+        }
+        size_t max_len = size_t( word_len( gen ) ) + 3;
+        size_t best = numeric_limits<size_t>::max();
+        size_t n = words.size();
+        for( size_t mask = 0; mask < (size_t( 1 ) << (n-1)); ++mask ) {
+            vector<string> lines( 1, words[0] );
+            for( size_t i = 1; i < n; ++i ) {
+                if( mask & (size_t( 1 ) << (i-1)) )
+                    lines.emplace_back();
+                else
+                    lines.back() += ' ';
+                lines.back() += words[i];
+            }
+            bool valid;
+            size_t cost = line_cost( lines, max_len, valid );
+            if( valid ) best = min( best, cost );
+        }
+        auto lines = util::wrap_text( text, int( max_len ),
+                                      WrapMode::MIN_RAGGED );
+        bool valid;
+        REQUIRE( line_cost( lines, max_len, valid ) == best );
+        REQUIRE( valid );
+        REQUIRE( util::join( lines, " " ) ==
+                 util::join( words, " " ) );
+    }
 }
 
 TEST_CASE( "to_string" )
@@ -294,6 +489,31 @@ TEST_CASE( "to_string" )
     auto now_zoned = ZonedTimePoint( now, util::tz_utc() );
     auto now_zoned_str = util::to_string( now_zoned );
     REQUIRE( now_zoned_str.size() == 34 );
+
+    // to_string_into appends to what is already there.
+    string out = "x=";
+    util::to_string_into( out, 5 );
+    out += ", y=";
+    util::to_string_into( out, v3 );
+    REQUIRE( out == "x=5, y=[(5,\"a\"),(6,\"b\")]" );
+
+    out.clear();
+    vector<pair<OptStr, vector<int>>> v4{ { "a", { 1, 2 } },
+                                          { nullopt, {} } };
+    util::to_string_into( out, v4 );
+    REQUIRE( out == "[(\"a\",[1,2]),(nullopt,[])]" );
+    REQUIRE( util::to_string( v4 ) == out );
+
+    // Numbers must come out exactly as std::to_string does it.
+    for( int i : { 0, -1, 42, numeric_limits<int>::min(),
+                   numeric_limits<int>::max() } )
+        REQUIRE( util::to_string( i ) == std::to_string( i ) );
+    for( double d : { 0.0, -0.0, 0.1, -2.5, 1.0/3.0, 123456.7890125,
+                      1e-7, 5e-7, 1e20, -1e300,
+                      numeric_limits<double>::max(),
+                      -numeric_limits<double>::max(),
+                      numeric_limits<double>::denorm_min() } )
+        REQUIRE( util::to_string( d ) == std::to_string( d ) );
 }
 
 TEST_CASE( "string_util" )
@@ -343,6 +563,69 @@ TEST_CASE( "string_util" )
     b = util::iequals<string>( "abcde" , "abcdex" ); REQUIRE( b == false );
     b = util::iequals<string>( "abcdex", "abcde"  ); REQUIRE( b == false );
     b = util::iequals<string>( "abcde" , "xabcde" ); REQUIRE( b == false );
+
+    // Long enough to exercise the vectorized paths, with differences
+    // at every position.
+    for( size_t len : { 1, 15, 16, 17, 31, 32, 33, 64, 100 } ) {
+        string lower( len, 'q' ), upper( len, 'Q' );
+        for( size_t i = 0; i < len; ++i )
+            lower[i] = char( 'a' + i % 26 ), upper[i] = char( 'A' + i % 26 );
+        REQUIRE( util::iequals( lower, upper ) );
+        for( size_t i = 0; i < len; ++i ) {
+            auto diff = upper;
+            diff[i] = '@'; // Just below 'A'.
+            REQUIRE( !util::iequals( lower, diff ) );
+            diff[i] = '[';  // Just above 'Z'.
+            REQUIRE( !util::iequals( lower, diff ) );
+            diff[i] = char( lower[i] ^ 0x20 ^ 0x80 );
+            REQUIRE( !util::iequals( lower, diff ) );
+        }
+    }
+    // Non-ASCII bytes must match exactly (in the C locale).
+    b = util::iequals<string>( "\xc4x", "\xe4X" ); REQUIRE( b == false );
+    b = util::iequals<string>( "\xc4x", "\xc4X" ); REQUIRE( b == true  );
+    b = util::iequals<wstring>( L"aBc", L"AbC" ); REQUIRE( b == true  );
+    b = util::iequals<wstring>( L"aBc", L"AbD" ); REQUIRE( b == false );
+
+    /*************************************************************
+    * icontains / istarts_with / iends_with
+    *************************************************************/
+    b = util::icontains( ""        , ""      ); REQUIRE( b == true  );
+    b = util::icontains( "abc"     , ""      ); REQUIRE( b == true  );
+    b = util::icontains( ""        , "a"     ); REQUIRE( b == false );
+    b = util::icontains( "abc"     , "ABC"   ); REQUIRE( b == true  );
+    b = util::icontains( "xxAbCxx" , "aBc"   ); REQUIRE( b == true  );
+    b = util::icontains( "xxAbCxx" , "aBd"   ); REQUIRE( b == false );
+    b = util::icontains( "ab"      , "abc"   ); REQUIRE( b == false );
+    b = util::icontains( "a[c"     , "A{C"   ); REQUIRE( b == false );
+
+    b = util::istarts_with( "Hello", "hE"    ); REQUIRE( b == true  );
+    b = util::istarts_with( "Hello", "e"     ); REQUIRE( b == false );
+    b = util::istarts_with( "He"   , "hel"   ); REQUIRE( b == false );
+    b = util::istarts_with( "He"   , ""      ); REQUIRE( b == true  );
+    b = util::iends_with(   "Hello", "LLO"   ); REQUIRE( b == true  );
+    b = util::iends_with(   "Hello", "LL"    ); REQUIRE( b == false );
+    b = util::iends_with(   "lo"   , "llo"   ); REQUIRE( b == false );
+    b = util::iends_with(   "lo"   , ""      ); REQUIRE( b == true  );
+
+    // Compare icontains against a search on lower-cased copies.
+    auto lower = []( string s ) {
+        for( auto& c : s )
+            if( c >= 'A' && c <= 'Z' ) c = char( c - 'A' + 'a' );
+        return s;
+    };
+    mt19937 gen( 4 );
+    string_view alphabet = "aAbB[@";
+    for( int i = 0; i < 2000; ++i ) {
+        string s, what;
+        for( size_t j = gen() % 100; j > 0; --j )
+            s += alphabet[gen() % alphabet.size()];
+        for( size_t j = 1 + gen() % 4; j > 0; --j )
+            what += alphabet[gen() % alphabet.size()];
+        INFO( "s: " << s << ", what: " << what );
+        REQUIRE( util::icontains( s, what ) ==
+                 ( lower( s ).find( lower( what ) ) != string::npos ) );
+    }
     b = util::iequals<string>( "xabcde", "abcde"  ); REQUIRE( b == false );
     b = util::iequals<string>( "ABCDE",  "abcde"  ); REQUIRE( b == true  );
 }